@@ -0,0 +1,13 @@
+  #!/bin/bash
+  # Project EQR images with a coordinator and local workers
+  # ($1 images path, $2 output directory, $3 camera mac address, $4 mountpoint, $5 number of workers, $6 port)
+  # workers on other hosts can join with: gnoproj -w <coordinator host>:$6 -o $2 -m $3 -d $4
+  GNOPROJ=${GNOPROJ:-gnoproj}
+  PORT=${6:-7777}
+  $GNOPROJ -i $1 -C $PORT &
+  COORDINATOR=$!
+  sleep 1
+  for i in $(seq 1 ${5:-$(nproc)}); do
+    $GNOPROJ -w localhost:$PORT -o $2 -m $3 -d $4 &
+  done
+  wait $COORDINATOR
@@ -0,0 +1,576 @@
+/*
+* gnoproj
+*
+* Copyright (c) 2013-2015 FOXEL SA - http://foxel.ch
+* Please read <http://foxel.ch/license> for more information.
+*
+*
+* Author(s):
+*
+*      Stéphane Flotron <s.flotron@foxel.ch>
+*
+* Contributor(s):
+*
+*      Luc Deschenaux <luc.deschenaux@foxel.ch>
+*
+*
+* This file is part of the FOXEL project <http://foxel.ch>.
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Affero General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Affero General Public License for more details.
+*
+* You should have received a copy of the GNU Affero General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*
+* Additional Terms:
+*
+*      You are required to preserve legal notices and author attributions in
+*      that material or in the Appropriate Legal Notices displayed by works
+*      containing it.
+*
+*      You are required to attribute the work as explained in the "Usage and
+*      Attribution" section of <http://foxel.ch/license>.
+*/
+
+#include "cluster.hpp"
+#include "lease.hpp"
+#include <iostream>
+#include <sstream>
+#include <algorithm>
+#include <deque>
+#include <map>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <unistd.h>
+#include <netdb.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+using namespace std;
+
+/*********************************************************************
+*  socket helpers
+*
+**********************************************************************/
+
+static bool  sendLine( const int fd, const std::string & sLine )
+{
+    const std::string sData = sLine + "\n";
+    size_t iSent = 0;
+
+    while( iSent < sData.size() )
+    {
+        const ssize_t n = send( fd, sData.c_str() + iSent, sData.size() - iSent, MSG_NOSIGNAL );
+        if( n <= 0 )
+            return false;
+        iSent += n;
+    }
+
+    return true;
+}
+
+// longest line of the protocol, peers sending more without a newline are dropped
+static const size_t iMaxLine = 65536;
+
+// extract a complete line from a receive buffer
+static bool  popLine( std::string & sBuffer, std::string & sLine )
+{
+    const std::string::size_type iEnd = sBuffer.find( '\n' );
+    if( iEnd == std::string::npos )
+        return false;
+
+    sLine = sBuffer.substr( 0, iEnd );
+    sBuffer.erase( 0, iEnd + 1 );
+    return true;
+}
+
+// blocking read of one line
+static bool  readLine( const int fd, std::string & sBuffer, std::string & sLine )
+{
+    char data[4096];
+
+    while( !popLine( sBuffer, sLine ) )
+    {
+        const ssize_t n = recv( fd, data, sizeof( data ), 0 );
+        if( n <= 0 || sBuffer.size() > iMaxLine )
+            return false;
+        sBuffer.append( data, n );
+    }
+
+    return true;
+}
+
+/*********************************************************************
+*  coordinator
+*
+**********************************************************************/
+
+enum jobStatus { JOB_QUEUED, JOB_ASSIGNED, JOB_RUNNING, JOB_DONE };
+
+struct workerState
+{
+    std::string        sName    = "";
+    std::string        sBuffer  = "";
+    std::deque<size_t> pending;         // assigned jobs not started yet
+    long               iRunning = -1;
+    size_t             iDone    = 0;
+    double             lfBusy   = 0.0;  // time spent projecting, in s
+
+    // mean projection time, or a negative value if not measured yet
+    double secondsPerJob() const { return iDone ? lfBusy / iDone : -1.0; }
+};
+
+struct coordinatorState
+{
+    std::vector<projectionJob> jobs;
+    std::vector<jobStatus>     status;
+    std::vector<int>           owner;
+    std::deque<size_t>         queue;
+    std::map<int, workerState> workers;
+    size_t                     iFinished = 0;
+    size_t                     iFailed   = 0;
+};
+
+// move jobs not started yet from the slowest worker to the requesting one
+static size_t  stealJobs( coordinatorState & state, const int fd, const size_t & iWanted )
+{
+    workerState & thief = state.workers[fd];
+
+    int    iVictim = -1;
+    double lfWorst = 0.0;
+
+    for( std::map<int, workerState>::iterator it = state.workers.begin(); it != state.workers.end(); ++it )
+    {
+        if( it->first == fd || it->second.pending.empty() )
+            continue;
+
+        const double lfSpeed = it->second.secondsPerJob() > 0.0 ? it->second.secondsPerJob() : 1.0;
+        const double lfRemaining = it->second.pending.size() * lfSpeed;
+
+        if( lfRemaining > lfWorst )
+        {
+            lfWorst = lfRemaining;
+            iVictim = it->first;
+        }
+    }
+
+    if( iVictim < 0 )
+        return 0;
+
+    workerState & victim = state.workers[iVictim];
+
+    // share the remaining jobs in proportion of the measured throughputs
+    const double lfVictim = victim.secondsPerJob() > 0.0 ? victim.secondsPerJob() : 1.0;
+    const double lfThief  = thief.secondsPerJob()  > 0.0 ? thief.secondsPerJob()  : lfVictim;
+
+    size_t iSteal = floor( victim.pending.size() * lfVictim / ( lfVictim + lfThief ) );
+    if( iSteal == 0 && lfThief < lfVictim )
+        iSteal = 1;
+    iSteal = std::min( iSteal, iWanted );
+
+    for( size_t i = 0; i < iSteal; ++i )
+    {
+        const size_t iJob = victim.pending.back();
+        victim.pending.pop_back();
+
+        state.owner[iJob] = fd;
+        thief.pending.push_back( iJob );
+    }
+
+    if( iSteal )
+        std::cerr << " " << thief.sName << " takes " << iSteal << " jobs from " << victim.sName << std::endl;
+
+    return iSteal;
+}
+
+// answer one worker request, return false if the connection must be closed
+static bool  handleRequest( coordinatorState & state, const int fd, const std::string & sLine )
+{
+    workerState & worker = state.workers[fd];
+
+    std::istringstream request( sLine );
+    std::string sCommand;
+    request >> sCommand;
+
+    if( sCommand == "HELLO" )
+    {
+        request >> worker.sName;
+        return sendLine( fd, "OK" );
+    }
+    else if( sCommand == "PULL" )
+    {
+        size_t iWanted = 1;
+        request >> iWanted;
+        iWanted = std::max( iWanted, (size_t) 1 );
+
+        const size_t iFirst = worker.pending.size();
+
+        size_t iCount = 0;
+        while( iCount < iWanted && !state.queue.empty() )
+        {
+            const size_t iJob = state.queue.front();
+            state.queue.pop_front();
+
+            state.status[iJob] = JOB_ASSIGNED;
+            state.owner[iJob]  = fd;
+            worker.pending.push_back( iJob );
+            ++iCount;
+        }
+
+        if( iCount == 0 )
+            iCount = stealJobs( state, fd, iWanted );
+
+        if( iCount == 0 )
+        {
+            if( state.iFinished == state.jobs.size() )
+                return sendLine( fd, "DONE" );
+            else
+                return sendLine( fd, "WAIT 1" );
+        }
+
+        std::ostringstream answer;
+        answer << "JOBS " << iCount;
+        bool bSent = sendLine( fd, answer.str() );
+
+        for( size_t i = iFirst; i < worker.pending.size() && bSent; ++i )
+        {
+            std::ostringstream job;
+            job << worker.pending[i] << " " << state.jobs[worker.pending[i]].sInputImage;
+            bSent = sendLine( fd, job.str() );
+        }
+
+        return bSent;
+    }
+    else if( sCommand == "START" )
+    {
+        size_t iJob = state.jobs.size();
+        request >> iJob;
+
+        std::deque<size_t>::iterator it = std::find( worker.pending.begin(), worker.pending.end(), iJob );
+        if( it == worker.pending.end() )
+            return sendLine( fd, "SKIP" );
+
+        worker.pending.erase( it );
+        worker.iRunning = iJob;
+        state.status[iJob] = JOB_RUNNING;
+
+        return sendLine( fd, "GO" );
+    }
+    else if( sCommand == "RESULT" )
+    {
+        size_t iJob = state.jobs.size();
+        int    iSuccess = 0;
+        double lfSeconds = 0.0;
+        request >> iJob >> iSuccess >> lfSeconds;
+
+        if( iJob < state.jobs.size() && state.status[iJob] == JOB_RUNNING && state.owner[iJob] == fd )
+        {
+            state.status[iJob] = JOB_DONE;
+            ++state.iFinished;
+
+            if( !iSuccess )
+            {
+                ++state.iFailed;
+                std::cerr << " " << worker.sName << " failed to project " << state.jobs[iJob].sInputImage << std::endl;
+            }
+
+            worker.iRunning = -1;
+            ++worker.iDone;
+            worker.lfBusy += lfSeconds;
+        }
+
+        return sendLine( fd, "OK" );
+    }
+
+    std::cerr << " Unknown request from " << worker.sName << ": " << sLine << std::endl;
+    return false;
+}
+
+// requeue unfinished jobs of a worker and report its metrics
+static void  closeWorker( coordinatorState & state, const int fd )
+{
+    workerState & worker = state.workers[fd];
+
+    if( worker.iRunning >= 0 )
+        worker.pending.push_front( worker.iRunning );
+
+    for( std::deque<size_t>::reverse_iterator it = worker.pending.rbegin(); it != worker.pending.rend(); ++it )
+    {
+        state.status[*it] = JOB_QUEUED;
+        state.owner[*it]  = -1;
+        state.queue.push_front( *it );
+    }
+
+    if( !worker.pending.empty() )
+        std::cerr << " " << worker.sName << " left, " << worker.pending.size() << " jobs requeued" << std::endl;
+
+    std::cerr << " " << worker.sName << ": " << worker.iDone << " jobs";
+    if( worker.iDone )
+        std::cerr << ", " << worker.secondsPerJob() << " s per job";
+    std::cerr << std::endl;
+
+    close( fd );
+    state.workers.erase( fd );
+}
+
+bool  runCoordinator( const std::vector<projectionJob> & jobs,
+            const int & iPort )
+{
+    if( iPort < 1 || iPort > 65535 )
+    {
+        std::cerr << " Invalid port " << iPort << std::endl;
+        return false;
+    }
+
+    coordinatorState state;
+    state.jobs = jobs;
+    state.status.assign( jobs.size(), JOB_QUEUED );
+    state.owner.assign( jobs.size(), -1 );
+    for( size_t i = 0; i < jobs.size(); ++i )
+        state.queue.push_back( i );
+
+    const int listener = socket( AF_INET6, SOCK_STREAM, 0 );
+    if( listener < 0 )
+    {
+        std::cerr << " Cannot create socket" << std::endl;
+        return false;
+    }
+
+    const int iOn = 1, iOff = 0;
+    setsockopt( listener, SOL_SOCKET, SO_REUSEADDR, &iOn, sizeof( iOn ) );
+    setsockopt( listener, IPPROTO_IPV6, IPV6_V6ONLY, &iOff, sizeof( iOff ) );
+
+    struct sockaddr_in6 address;
+    memset( &address, 0, sizeof( address ) );
+    address.sin6_family = AF_INET6;
+    address.sin6_addr   = in6addr_any;
+    address.sin6_port   = htons( iPort );
+
+    if( bind( listener, (struct sockaddr *) &address, sizeof( address ) ) != 0 || listen( listener, 64 ) != 0 )
+    {
+        std::cerr << " Cannot listen on port " << iPort << std::endl;
+        close( listener );
+        return false;
+    }
+
+    std::cerr << " Coordinator listening on port " << iPort << ", " << jobs.size() << " jobs" << std::endl;
+
+    // serve until all jobs are finished and all workers are gone
+    while( state.iFinished < state.jobs.size() || !state.workers.empty() )
+    {
+        std::vector<struct pollfd> fds( 1 );
+        fds[0].fd     = listener;
+        fds[0].events = POLLIN;
+
+        for( std::map<int, workerState>::const_iterator it = state.workers.begin(); it != state.workers.end(); ++it )
+        {
+            struct pollfd entry;
+            entry.fd      = it->first;
+            entry.events  = POLLIN;
+            entry.revents = 0;
+            fds.push_back( entry );
+        }
+
+        if( poll( &fds[0], fds.size(), -1 ) < 0 )
+            continue;
+
+        if( fds[0].revents & POLLIN )
+        {
+            const int fd = accept( listener, NULL, NULL );
+            if( fd >= 0 )
+            {
+                setsockopt( fd, IPPROTO_TCP, TCP_NODELAY, &iOn, sizeof( iOn ) );
+                state.workers[fd].sName = "unknown";
+            }
+        }
+
+        for( size_t i = 1; i < fds.size(); ++i )
+        {
+            if( !( fds[i].revents & ( POLLIN | POLLHUP | POLLERR ) ) )
+                continue;
+
+            const int fd = fds[i].fd;
+            char data[4096];
+            const ssize_t n = recv( fd, data, sizeof( data ), 0 );
+
+            bool bConnected = n > 0;
+            if( bConnected )
+            {
+                state.workers[fd].sBuffer.append( data, n );
+
+                std::string sLine;
+                while( bConnected && popLine( state.workers[fd].sBuffer, sLine ) )
+                    bConnected = handleRequest( state, fd, sLine );
+
+                if( bConnected && state.workers[fd].sBuffer.size() > iMaxLine )
+                {
+                    std::cerr << " Worker " << state.workers[fd].sName << " sent a line longer than " << iMaxLine << " bytes, disconnected" << std::endl;
+                    bConnected = false;
+                }
+            }
+
+            if( !bConnected )
+                closeWorker( state, fd );
+        }
+    }
+
+    close( listener );
+
+    std::cerr << " All jobs finished, " << state.iFailed << " failed" << std::endl;
+
+    return state.iFailed == 0;
+};
+
+/*********************************************************************
+*  worker
+*
+**********************************************************************/
+
+static int  connectCoordinator( const std::string & sCoordinator )
+{
+    const std::string::size_type iColon = sCoordinator.rfind( ':' );
+    if( iColon == std::string::npos )
+    {
+        std::cerr << " Invalid coordinator address " << sCoordinator << ", expected host:port" << std::endl;
+        return -1;
+    }
+
+    const std::string sHost = sCoordinator.substr( 0, iColon );
+    const std::string sPort = sCoordinator.substr( iColon + 1 );
+
+    struct addrinfo hints;
+    memset( &hints, 0, sizeof( hints ) );
+    hints.ai_family   = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    struct addrinfo * result = NULL;
+    if( getaddrinfo( sHost.c_str(), sPort.c_str(), &hints, &result ) != 0 )
+    {
+        std::cerr << " Cannot resolve coordinator " << sCoordinator << std::endl;
+        return -1;
+    }
+
+    int fd = -1;
+    for( struct addrinfo * it = result; it != NULL && fd < 0; it = it->ai_next )
+    {
+        fd = socket( it->ai_family, it->ai_socktype, it->ai_protocol );
+        if( fd >= 0 && connect( fd, it->ai_addr, it->ai_addrlen ) != 0 )
+        {
+            close( fd );
+            fd = -1;
+        }
+    }
+
+    freeaddrinfo( result );
+
+    if( fd < 0 )
+        std::cerr << " Cannot connect to coordinator " << sCoordinator << std::endl;
+    else
+    {
+        const int iOn = 1;
+        setsockopt( fd, IPPROTO_TCP, TCP_NODELAY, &iOn, sizeof( iOn ) );
+    }
+
+    return fd;
+}
+
+bool  runWorker( const std::string & sCoordinator,
+            const projectFunction & project,
+            const double & lfBatchTime )
+{
+    const int fd = connectCoordinator( sCoordinator );
+    if( fd < 0 )
+        return false;
+
+    std::string sBuffer;
+    std::string sLine;
+    bool bSuccess = true;
+
+    // mean projection time, updated as jobs complete
+    double lfSecondsPerJob = -1.0;
+
+    bool bConnected = sendLine( fd, "HELLO " + workerName() ) && readLine( fd, sBuffer, sLine );
+
+    while( bConnected )
+    {
+        // pull enough jobs to keep busy for about lfBatchTime
+        size_t iWanted = 1;
+        if( lfSecondsPerJob > 0.0 )
+            iWanted = std::max( (size_t) 1, (size_t) ( lfBatchTime / lfSecondsPerJob ) );
+
+        std::ostringstream pull;
+        pull << "PULL " << iWanted;
+
+        if( !sendLine( fd, pull.str() ) || !readLine( fd, sBuffer, sLine ) )
+            break;
+
+        std::istringstream answer( sLine );
+        std::string sCommand;
+        answer >> sCommand;
+
+        if( sCommand == "DONE" )
+            break;
+
+        if( sCommand == "WAIT" )
+        {
+            double lfWait = 1.0;
+            answer >> lfWait;
+            usleep( lfWait * 1e6 );
+            continue;
+        }
+
+        size_t iCount = 0;
+        answer >> iCount;
+
+        std::vector<size_t>      ids( iCount );
+        std::vector<std::string> images( iCount );
+
+        for( size_t i = 0; i < iCount && bConnected; ++i )
+        {
+            bConnected = readLine( fd, sBuffer, sLine );
+
+            std::istringstream job( sLine );
+            job >> ids[i];
+            job.get();
+            std::getline( job, images[i] );
+        }
+
+        for( size_t i = 0; i < iCount && bConnected; ++i )
+        {
+            std::ostringstream start;
+            start << "START " << ids[i];
+
+            bConnected = sendLine( fd, start.str() ) && readLine( fd, sBuffer, sLine );
+            if( !bConnected || sLine != "GO" )
+                continue;
+
+            const std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+            const bool bProjected = project( images[i] );
+            const double lfSeconds = std::chrono::duration<double>( std::chrono::steady_clock::now() - t0 ).count();
+
+            bSuccess &= bProjected;
+            lfSecondsPerJob = lfSecondsPerJob < 0.0 ? lfSeconds : 0.8 * lfSecondsPerJob + 0.2 * lfSeconds;
+
+            std::ostringstream result;
+            result << "RESULT " << ids[i] << " " << bProjected << " " << lfSeconds;
+
+            bConnected = sendLine( fd, result.str() ) && readLine( fd, sBuffer, sLine );
+        }
+    }
+
+    close( fd );
+
+    return bSuccess;
+};
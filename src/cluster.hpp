@@ -0,0 +1,116 @@
+/*
+* gnoproj
+*
+* Copyright (c) 2013-2015 FOXEL SA - http://foxel.ch
+* Please read <http://foxel.ch/license> for more information.
+*
+*
+* Author(s):
+*
+*      Stéphane Flotron <s.flotron@foxel.ch>
+*
+* Contributor(s):
+*
+*      Luc Deschenaux <luc.deschenaux@foxel.ch>
+*
+*
+* This file is part of the FOXEL project <http://foxel.ch>.
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Affero General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Affero General Public License for more details.
+*
+* You should have received a copy of the GNU Affero General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*
+* Additional Terms:
+*
+*      You are required to preserve legal notices and author attributions in
+*      that material or in the Appropriate Legal Notices displayed by works
+*      containing it.
+*
+*      You are required to attribute the work as explained in the "Usage and
+*      Attribution" section of <http://foxel.ch/license>.
+*/
+
+  /*! \file cluster.hpp
+   * \author Stephane Flotron <s.flotron@foxel.ch>
+   */
+
+#ifndef CLUSTER_HPP_
+#define CLUSTER_HPP_
+
+#include "jobs.hpp"
+#include <functional>
+#include <string>
+#include <vector>
+
+/*
+* Coordinator / worker protocol
+*
+* Text lines over TCP, each worker request gets exactly one answer:
+*
+*   HELLO <name>                  -> OK
+*   PULL <n>                      -> JOBS <k> followed by k lines "<id> <image>"
+*                                    WAIT <seconds> if jobs are still running elsewhere
+*                                    DONE if all jobs are finished
+*   START <id>                    -> GO, or SKIP if the job was reassigned
+*   RESULT <id> <0|1> <seconds>   -> OK
+*
+* Workers pull a number of jobs matching their measured throughput. When the
+* queue is empty, jobs not started yet by the slowest workers are reassigned
+* to the workers asking for more.
+*/
+
+/*! \brief Projection callback used by workers, returns false on failure */
+typedef std::function<bool ( const std::string & input_image )> projectFunction;
+
+/*********************************************************************
+*  coordinator
+*
+**********************************************************************/
+
+/*! \brief Coordinator main loop
+*
+* This function owns the job manifest and hands out jobs to workers
+* connecting on the given port. It returns once all jobs are finished and
+* all workers are disconnected.
+*
+* \param jobs    The job manifest
+* \param iPort   TCP port to listen on, from 1 to 65535
+*
+* \return bool value that says if all jobs were projected successfully
+*/
+
+bool  runCoordinator( const std::vector<projectionJob> & jobs,
+            const int & iPort ) ;
+
+/*********************************************************************
+*  worker
+*
+**********************************************************************/
+
+/*! \brief Worker main loop
+*
+* This function connects to a coordinator, pulls jobs and projects them
+* until the coordinator reports that all jobs are finished.
+*
+* \param sCoordinator  Coordinator address, as host:port
+* \param project       Function called to project one EQR image
+* \param lfBatchTime   Targeted processing time of a pulled batch, in seconds
+*
+* \return bool value that says if all jobs of the worker were successful
+*/
+
+bool  runWorker( const std::string & sCoordinator,
+            const projectFunction & project,
+            const double & lfBatchTime ) ;
+
+#endif
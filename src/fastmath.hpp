@@ -0,0 +1,137 @@
+/*
+* gnoproj
+*
+* Copyright (c) 2013-2015 FOXEL SA - http://foxel.ch
+* Please read <http://foxel.ch/license> for more information.
+*
+*
+* Author(s):
+*
+*      Stéphane Flotron <s.flotron@foxel.ch>
+*
+* Contributor(s):
+*
+*      Luc Deschenaux <luc.deschenaux@foxel.ch>
+*
+*
+* This file is part of the FOXEL project <http://foxel.ch>.
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Affero General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Affero General Public License for more details.
+*
+* You should have received a copy of the GNU Affero General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*
+* Additional Terms:
+*
+*      You are required to preserve legal notices and author attributions in
+*      that material or in the Appropriate Legal Notices displayed by works
+*      containing it.
+*
+*      You are required to attribute the work as explained in the "Usage and
+*      Attribution" section of <http://foxel.ch/license>.
+*/
+
+  /*! \file fastmath.hpp
+   * \author Stephane Flotron <s.flotron@foxel.ch>
+   */
+
+#ifndef FASTMATH_HPP_
+#define FASTMATH_HPP_
+
+#include <cmath>
+#include <algorithm>
+
+/* the approximations are always inlined, as a call in a loop prevents its
+   vectorization whatever the size of the file including them */
+#define FASTMATH_INLINE static inline __attribute__(( always_inline ))
+
+/*********************************************************************
+*  single precision arctangent
+*
+**********************************************************************/
+
+/*! \brief Fast single precision atan2
+*
+* Polynomial approximation of atan2 (Cephes atanf), written without branches
+* so that loops calling it are vectorized. The maximum absolute error is
+* below 3e-7 radian, which is 0.001 pixel on a 16384 pixels wide panorama.
+*
+* \param y   y coordinate
+* \param x   x coordinate
+*
+* \return angle in ]-pi,pi]
+*/
+
+FASTMATH_INLINE float  fastAtan2( const float y, const float x )
+{
+    const float ax = std::fabs( x );
+    const float ay = std::fabs( y );
+    const float mx = std::max( ax, ay );
+    const float mn = std::min( ax, ay );
+
+    // reduction to [0,tan(pi/8)], divisions are not conditional so that
+    // the selections can be vectorized
+    float a = mn / std::max( mx, 1e-30f );
+    const float ar = ( a - 1.0f ) / ( a + 1.0f );
+    const bool bReduce = a > 0.41421356f;
+    a = bReduce ? ar : a;
+
+    const float z = a * a;
+    float r = ( ( ( 8.05374449538e-2f * z - 1.38776856032e-1f ) * z + 1.99777106478e-1f ) * z - 3.33329491539e-1f ) * z * a + a;
+
+    // back to the complete circle
+    r = bReduce ? r + 0.78539816f : r;
+    r = ay > ax ? 1.57079633f - r : r;
+    r = x < 0.0f ? 3.14159265f - r : r;
+
+    return y < 0.0f ? -r : r;
+}
+
+/*********************************************************************
+*  single precision sine and cosine
+*
+**********************************************************************/
+
+/*! \brief Fast single precision sine and cosine
+*
+* Polynomial approximations of sin and cos (Cephes sinf and cosf) on the
+* quadrant of the angle, written without branches so that loops calling it
+* are vectorized. The maximum absolute error is below 1e-7 for angles of a
+* few turns, as the longitudes and latitudes of a panorama.
+*
+* \param a   angle in radian
+* \param s   sine of the angle
+* \param c   cosine of the angle
+*/
+
+FASTMATH_INLINE void  fastSinCos( const float a, float & s, float & c )
+{
+    // reduction to [-pi/4,pi/4], pi/2 being split in three terms ; the
+    // quadrant is rounded by conversion, as floor is not vectorized on SSE2
+    const int   iQuadrant = (int) ( a * 0.63661977f + ( a < 0.0f ? -0.5f : 0.5f ) );
+    const float q = iQuadrant;
+    const float r = ( ( a - q * 1.5703125f ) - q * 4.837512969970703125e-4f ) - q * 7.549789948768648e-8f;
+
+    const float z  = r * r;
+    const float sr = ( ( -1.9515295891e-4f * z + 8.3321608736e-3f ) * z - 1.6666654611e-1f ) * z * r + r;
+    const float cr = ( ( 2.443315711809948e-5f * z - 1.388731625493765e-3f ) * z + 4.166664568298827e-2f ) * z * z - 0.5f * z + 1.0f;
+
+    // back to the quadrant of the angle
+    const bool bSwap = iQuadrant & 1;
+    const float s0 = bSwap ? cr : sr;
+    const float c0 = bSwap ? sr : cr;
+
+    s = ( iQuadrant & 2 ) ? -s0 : s0;
+    c = ( ( iQuadrant + 1 ) & 2 ) ? -c0 : c0;
+}
+
+#endif
@@ -0,0 +1,394 @@
+/*
+* gnoproj
+*
+* Copyright (c) 2013-2015 FOXEL SA - http://foxel.ch
+* Please read <http://foxel.ch/license> for more information.
+*
+*
+* Author(s):
+*
+*      Stéphane Flotron <s.flotron@foxel.ch>
+*
+* Contributor(s):
+*
+*      Luc Deschenaux <luc.deschenaux@foxel.ch>
+*
+*
+* This file is part of the FOXEL project <http://foxel.ch>.
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Affero General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Affero General Public License for more details.
+*
+* You should have received a copy of the GNU Affero General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*
+* Additional Terms:
+*
+*      You are required to preserve legal notices and author attributions in
+*      that material or in the Appropriate Legal Notices displayed by works
+*      containing it.
+*
+*      You are required to attribute the work as explained in the "Usage and
+*      Attribution" section of <http://foxel.ch/license>.
+*/
+
+#include "geometry.hpp"
+#include "kernels.hpp"
+#include <unistd.h>
+
+using namespace std;
+
+/*********************************************************************
+*  rotation matrix
+*
+**********************************************************************/
+
+void  rotationMatrix( const double & lfAzimuth,
+            const double & lfElevation,
+            const double & lfRoll,
+            double lfMatrix[3][3] )
+{
+    const double ca = cos( lfAzimuth   ), sa = sin( lfAzimuth   );
+    const double ce = cos( lfElevation ), se = sin( lfElevation );
+    const double cr = cos( lfRoll      ), sr = sin( lfRoll      );
+
+    /* azimuth around vertical axis, elevation around x axis, roll around optical axis */
+    const double lfRotAzimuth  [3][3] = { {  ca, 0.0,  sa }, { 0.0, 1.0, 0.0 }, { -sa, 0.0,  ca } };
+    const double lfRotElevation[3][3] = { { 1.0, 0.0, 0.0 }, { 0.0,  ce, -se }, { 0.0,  se,  ce } };
+    const double lfRotRoll     [3][3] = { {  cr, -sr, 0.0 }, {  sr,  cr, 0.0 }, { 0.0, 0.0, 1.0 } };
+
+    double lfTemp[3][3];
+    for( int i = 0; i < 3; ++i )
+        for( int j = 0; j < 3; ++j )
+            lfTemp[i][j] = lfRotElevation[i][0] * lfRotRoll[0][j] + lfRotElevation[i][1] * lfRotRoll[1][j] + lfRotElevation[i][2] * lfRotRoll[2][j];
+
+    for( int i = 0; i < 3; ++i )
+        for( int j = 0; j < 3; ++j )
+            lfMatrix[i][j] = lfRotAzimuth[i][0] * lfTemp[0][j] + lfRotAzimuth[i][1] * lfTemp[1][j] + lfRotAzimuth[i][2] * lfTemp[2][j];
+};
+
+/*********************************************************************
+*  gnomonic geometry of elphel sensors
+*
+**********************************************************************/
+
+static void  panoramaGeometry( const sensorData & sD,
+            gnomonicGeometry & gG )
+{
+    gG.lfPixelSize = sD.lfPixelSize;
+    gG.lfMapWidth  = sD.lfImageFullWidth;
+    gG.lfMapHeight = sD.lfImageFullHeight - 1; // there's an extra pixel for wrapping
+    gG.lfCornerX   = sD.lfXPosition;
+    gG.lfCornerY   = sD.lfYPosition;
+
+    rotationMatrix( sD.lfAzimuth + sD.lfHeading + LG_PI, sD.lfElevation, sD.lfRoll, gG.lfMatrix );
+}
+
+void  elphelGeometry( const sensorData & sD,
+            gnomonicGeometry & gG )
+{
+    panoramaGeometry( sD, gG );
+
+    gG.lfpx0         = sD.lfpx0;
+    gG.lfpy0         = sD.lfpy0;
+    gG.lfFocalLength = sD.lfFocalLength;
+};
+
+void  centerGeometry( const sensorData & sD,
+            const double & focal,
+            gnomonicGeometry & gG )
+{
+    panoramaGeometry( sD, gG );
+
+    gG.lfpx0         = sD.lfWidth  / 2.0;
+    gG.lfpy0         = sD.lfHeight / 2.0;
+    gG.lfFocalLength = focal;
+};
+
+void  attitudeGeometry( const frameAttitude & fA,
+            gnomonicGeometry & gG )
+{
+    double lfAttitude[3][3];
+    rotationMatrix( fA.lfYaw, fA.lfPitch, fA.lfRoll, lfAttitude );
+
+    double lfMatrix[3][3];
+    for( int i = 0; i < 3; ++i )
+        for( int j = 0; j < 3; ++j )
+            lfMatrix[i][j] = lfAttitude[i][0] * gG.lfMatrix[0][j] + lfAttitude[i][1] * gG.lfMatrix[1][j] + lfAttitude[i][2] * gG.lfMatrix[2][j];
+
+    for( int i = 0; i < 3; ++i )
+        for( int j = 0; j < 3; ++j )
+            gG.lfMatrix[i][j] = lfMatrix[i][j];
+};
+
+void  scaleGeometry( const double & lfScale,
+            gnomonicGeometry & gG )
+{
+    // pixel centers of a reduced image are centers of blocks of the full one
+    const double lfOffset = ( lfScale - 1.0 ) / 2.0;
+
+    gG.lfpx0       = ( gG.lfpx0 - lfOffset ) / lfScale;
+    gG.lfpy0       = ( gG.lfpy0 - lfOffset ) / lfScale;
+    gG.lfPixelSize = gG.lfPixelSize * lfScale;
+
+    gG.lfMapWidth  = gG.lfMapWidth  / lfScale;
+    gG.lfMapHeight = gG.lfMapHeight / lfScale;
+    gG.lfCornerX   = ( gG.lfCornerX + lfOffset ) / lfScale;
+    gG.lfCornerY   = ( gG.lfCornerY + lfOffset ) / lfScale;
+};
+
+/*********************************************************************
+*  projection map
+*
+**********************************************************************/
+
+void  computeMap( const gnomonicGeometry & gG,
+            const int & iWidth,
+            const int & iHeight,
+            projectionMap & pM,
+            const bool & bFastMath )
+{
+    selectMapKernel( bFastMath )( gG, iWidth, iHeight, pM );
+};
+
+/*********************************************************************
+*  composed projection map
+*
+**********************************************************************/
+
+void  composeMap( const gnomonicGeometry & gG,
+            const int & iWidth,
+            const int & iHeight,
+            const float * pWarpX,
+            const float * pWarpY,
+            projectionMap & pM )
+{
+    pM = projectionMap();
+    pM.iWidth  = iWidth;
+    pM.iHeight = iHeight;
+    pM.vMapX.resize( (size_t) iWidth * iHeight );
+    pM.vMapY.resize( (size_t) iWidth * iHeight );
+
+    #pragma omp parallel for schedule(static)
+    for( int y = 0; y < iHeight; ++y )
+    {
+        const size_t iRow = (size_t) y * iWidth;
+
+        for( int x = 0; x < iWidth; ++x )
+        {
+            double u, v;
+            sensorToEqr( gG, pWarpX[iRow + x], pWarpY[iRow + x], u, v );
+
+            pM.vMapX[iRow + x] = u;
+            pM.vMapY[iRow + x] = v;
+        }
+    }
+};
+
+/*********************************************************************
+*  sparse projection map
+*
+**********************************************************************/
+
+double  computeSparseMap( const gnomonicGeometry & gG,
+            const int & iWidth,
+            const int & iHeight,
+            const double & lfThreshold,
+            projectionMap & pM )
+{
+    double lfDeviation = 0.0;
+    double lfPrevious  = HUGE_VAL;
+
+    for( int iStep = 64; iStep >= 2; iStep /= 2 )
+    {
+        // one more node than needed on each axis, so that every cell is closed
+        pM.iWidth      = iWidth;
+        pM.iHeight     = iHeight;
+        pM.iStep       = iStep;
+        pM.iGridWidth  = ( iWidth  - 1 ) / iStep + 2;
+        pM.iGridHeight = ( iHeight - 1 ) / iStep + 2;
+        pM.lfWrap      = gG.lfMapWidth;
+
+        pM.vMapX.resize( (size_t) pM.iGridWidth * pM.iGridHeight );
+        pM.vMapY.resize( (size_t) pM.iGridWidth * pM.iGridHeight );
+
+        for( int r = 0; r < pM.iGridHeight; ++r )
+        {
+            for( int c = 0; c < pM.iGridWidth; ++c )
+            {
+                double u, v;
+                sensorToEqr( gG, c * iStep, r * iStep, u, v );
+
+                // unwrap longitude relative to the left node, or to the node above
+                const size_t i = (size_t) r * pM.iGridWidth + c;
+                const double lfReference = c > 0 ? pM.vMapX[i - 1] : ( r > 0 ? pM.vMapX[i - pM.iGridWidth] : u );
+
+                u -= gG.lfMapWidth * std::round( ( u - lfReference ) / gG.lfMapWidth );
+
+                pM.vMapX[i] = u;
+                pM.vMapY[i] = v;
+            }
+        }
+
+        // nodes, middle of the edges and middle of the cells
+        lfDeviation = mapDeviation( gG, pM, iStep / 2 );
+
+        // interpolation error should quarter with each halving, unless a
+        // singularity such as a pole lies in the sensor field of view
+        if( lfDeviation <= lfThreshold || lfDeviation > lfPrevious / 2.0 )
+            break;
+
+        lfPrevious = lfDeviation;
+    }
+
+    return lfDeviation;
+};
+
+/*********************************************************************
+*  traversal of the sensor image
+*
+**********************************************************************/
+
+void  planTraversal( projectionMap & pM,
+            const int & iPixelBytes,
+            const int & iFrames )
+{
+    if( pM.iWidth < 2 || pM.iHeight < 2 )
+        return;
+
+    // Jacobian of the map at the center of the sensor
+    const int x = pM.iWidth  / 2 - 1;
+    const int y = pM.iHeight / 2 - 1;
+
+    std::vector<float> vBuffer( 4 * (size_t) pM.iWidth );
+    const float * pX0;
+    const float * pY0;
+    const float * pX1;
+    const float * pY1;
+    mapRow( pM, y    , &vBuffer[0]              , &vBuffer[pM.iWidth]    , pX0, pY0 );
+    mapRow( pM, y + 1, &vBuffer[2 * pM.iWidth]  , &vBuffer[3 * pM.iWidth], pX1, pY1 );
+
+    double lfdUx = pX0[x + 1] - pX0[x];
+    double lfdUy = pX1[x]     - pX0[x];
+    const double lfdVx = pY0[x + 1] - pY0[x];
+    const double lfdVy = pY1[x]     - pY0[x];
+
+    // longitude wrapping
+    if( pM.lfWrap > 0.0 )
+    {
+        lfdUx -= pM.lfWrap * std::round( lfdUx / pM.lfWrap );
+        lfdUy -= pM.lfWrap * std::round( lfdUy / pM.lfWrap );
+    }
+
+    // follow the sensor direction that crosses the fewest EQR rows
+    pM.bColumns = std::fabs( lfdVy ) < std::fabs( lfdVx );
+
+    // EQR pixels covered by a sensor pixel
+    const double lfScale = std::max( std::fabs( lfdUx * lfdVy - lfdUy * lfdVx ), 1.0 );
+
+    long lCache = sysconf( _SC_LEVEL2_CACHE_SIZE );
+    if( lCache <= 0 )
+        lCache = 256 * 1024;
+
+    const double lfTileBytes = 2.0 * sizeof( float ) + lfScale * iPixelBytes * std::max( iFrames, 1 );
+
+    pM.iTile = 16;
+    while( pM.iTile < 256 && 4.0 * pM.iTile * pM.iTile * lfTileBytes <= lCache / 2 )
+        pM.iTile *= 2;
+
+    // when even the smallest tile overflows the cache and samples cross an
+    // EQR row every few pixels, cache lines are not reused between rows of
+    // the tile and a blocked copy of the EQR tile pays for its conversion
+    const bool bOverflow = pM.iTile * pM.iTile * lfTileBytes > lCache / 2;
+    pM.iLayout = bOverflow && std::min( std::fabs( lfdVx ), std::fabs( lfdVy ) ) > 0.25 ? LAYOUT_BLOCKS : LAYOUT_ROWS;
+};
+
+/*********************************************************************
+*  projection map deviation
+*
+**********************************************************************/
+
+double  mapDeviation( const gnomonicGeometry & gG,
+            const projectionMap & pM,
+            const int & iStep )
+{
+    double lfDeviation = 0.0;
+
+    #pragma omp parallel reduction(max:lfDeviation)
+    {
+        std::vector<float> vBufferX( pM.iWidth );
+        std::vector<float> vBufferY( pM.iWidth );
+
+        #pragma omp for schedule(static)
+        for( int y = 0; y < pM.iHeight; y += iStep )
+        {
+            const float * pX;
+            const float * pY;
+            mapRow( pM, y, vBufferX.data(), vBufferY.data(), pX, pY );
+
+            for( int x = 0; x < pM.iWidth; x += iStep )
+            {
+                double u, v;
+                sensorToEqr( gG, x, y, u, v );
+
+                double du = std::fabs( pX[x] - u );
+                const double dv = std::fabs( pY[x] - v );
+
+                // longitude wrapping
+                du = std::min( du, std::fabs( du - gG.lfMapWidth ) );
+
+                lfDeviation = std::max( lfDeviation, sqrt( du * du + dv * dv ) );
+            }
+        }
+    }
+
+    return lfDeviation;
+};
+
+/*********************************************************************
+*  footprint of a sensor image in the EQR tile
+*
+**********************************************************************/
+
+void  eqrFootprint( const gnomonicGeometry & gG,
+            const int & iWidth,
+            const int & iHeight,
+            double & lfUMin,
+            double & lfUMax,
+            double & lfVMin,
+            double & lfVMax )
+{
+    lfUMin = lfVMin =  HUGE_VAL;
+    lfUMax = lfVMax = -HUGE_VAL;
+
+    double lfReference = 0.0;
+
+    for( int y = 0; y < iHeight + 8; y += 8 )
+    {
+        const int iRow = std::min( y, iHeight - 1 );
+
+        for( int x = 0; x < iWidth + 8; x += 8 )
+        {
+            double u, v;
+            sensorToEqr( gG, std::min( x, iWidth - 1 ), iRow, u, v );
+
+            // unwrap longitude relative to the previous sample
+            if( x > 0 || y > 0 )
+                u -= gG.lfMapWidth * std::round( ( u - lfReference ) / gG.lfMapWidth );
+            lfReference = u;
+
+            lfUMin = std::min( lfUMin, u );
+            lfUMax = std::max( lfUMax, u );
+            lfVMin = std::min( lfVMin, v );
+            lfVMax = std::max( lfVMax, v );
+        }
+    }
+};
@@ -0,0 +1,565 @@
+/*
+* gnoproj
+*
+* Copyright (c) 2013-2015 FOXEL SA - http://foxel.ch
+* Please read <http://foxel.ch/license> for more information.
+*
+*
+* Author(s):
+*
+*      Stéphane Flotron <s.flotron@foxel.ch>
+*
+* Contributor(s):
+*
+*      Luc Deschenaux <luc.deschenaux@foxel.ch>
+*
+*
+* This file is part of the FOXEL project <http://foxel.ch>.
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Affero General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Affero General Public License for more details.
+*
+* You should have received a copy of the GNU Affero General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*
+* Additional Terms:
+*
+*      You are required to preserve legal notices and author attributions in
+*      that material or in the Appropriate Legal Notices displayed by works
+*      containing it.
+*
+*      You are required to attribute the work as explained in the "Usage and
+*      Attribution" section of <http://foxel.ch/license>.
+*/
+
+  /*! \file geometry.hpp
+   * \author Stephane Flotron <s.flotron@foxel.ch>
+   */
+
+#ifndef GEOMETRY_HPP_
+#define GEOMETRY_HPP_
+
+#include "tools.hpp"
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+/******************************************************************************
+* gnomonicGeometry
+*****************************************************************************/
+
+/*! \struct gnomonicGeometry
+* \brief structure used to store the geometry of a gnomonic projection
+*
+* A sensor pixel (x,y) defines the ray ((x-px0)*pixelSize, (y-py0)*pixelSize,
+* focal) in the sensor frame (x right, y down, z forward). It is rotated by
+* roll, elevation and azimuth in the panorama frame and mapped in the EQR tile
+* through its longitude and latitude, using the same conventions as
+* lg_ttg_elphel and lg_ttg_center in libgnomonic.
+*
+* \var gnomonicGeometry::lfMatrix
+*  Rotation from sensor frame to panorama frame
+* \var gnomonicGeometry::lfpx0
+*  x coordinate of principal point of sensor image, in pixels
+* \var gnomonicGeometry::lfpy0
+*  y coordinate of principal point of sensor image, in pixels
+* \var gnomonicGeometry::lfPixelSize
+*  pixel size in mm
+* \var gnomonicGeometry::lfFocalLength
+*  Focal length in mm
+* \var gnomonicGeometry::lfMapWidth
+*  Stitched EQR panorama width
+* \var gnomonicGeometry::lfMapHeight
+*  Stitched EQR panorama height, without the extra wrapping pixel
+* \var gnomonicGeometry::lfCornerX
+*  X coordinate of left corner of EQR tile in panorama
+* \var gnomonicGeometry::lfCornerY
+*  Y coordinate of left corner of EQR tile in panorama
+*/
+
+struct gnomonicGeometry
+{
+  double lfMatrix[3][3] = { { 1.0, 0.0, 0.0 }, { 0.0, 1.0, 0.0 }, { 0.0, 0.0, 1.0 } };
+
+  double lfpx0         = 0.0;
+  double lfpy0         = 0.0;
+  double lfPixelSize   = 0.0;
+  double lfFocalLength = 0.0;
+  double lfMapWidth    = 0.0;
+  double lfMapHeight   = 0.0;
+  double lfCornerX     = 0.0;
+  double lfCornerY     = 0.0;
+};
+
+/******************************************************************************
+* projectionMap
+*****************************************************************************/
+
+/*! \struct projectionMap
+* \brief structure used to store the EQR tile coordinates of each sensor pixel
+*
+* \var projectionMap::iWidth
+*  Width of sensor image
+* \var projectionMap::iHeight
+*  Height of sensor image
+* \var projectionMap::iStep
+*  Spacing of the grid nodes in pixels, 0 for a dense map
+* \var projectionMap::iGridWidth
+*  Number of grid nodes per row of a sparse map
+* \var projectionMap::iGridHeight
+*  Number of grid rows of a sparse map
+* \var projectionMap::lfWrap
+*  Width of the panorama, used to wrap interpolated longitudes
+* \var projectionMap::iTile
+*  Side of the tiles the sensor image is traversed by, 0 for the default
+* \var projectionMap::bColumns
+*  Traverse the tiles by columns instead of rows
+* \var projectionMap::iLayout
+*  Memory layout of the EQR tile during resampling (see sourceLayout)
+* \var projectionMap::vMapX
+*  x coordinate in EQR tile of each sensor pixel (or grid node), row major
+* \var projectionMap::vMapY
+*  y coordinate in EQR tile of each sensor pixel (or grid node), row major
+* \var projectionMap::vGain
+*  Photometric gain of each sensor pixel, row major, empty without correction
+* \var projectionMap::vPlaneGain
+*  Photometric gain of each plane (e.g. white balance), empty without correction
+* \var projectionMap::iColorspace
+*  Colorspace of the samples stored in the sensor images (see outputColorspace)
+* \var projectionMap::iLevels
+*  Number of reduced levels (1/2, 1/4, ...) of the sensor images, stored after
+*  the sensor images of all frames in the output vector, level by level
+*/
+
+struct projectionMap
+{
+  int iWidth      = 0;
+  int iHeight     = 0;
+  int iStep       = 0;
+  int iGridWidth  = 0;
+  int iGridHeight = 0;
+
+  double lfWrap   = 0.0;
+
+  int  iTile      = 0;
+  bool bColumns   = false;
+  int  iLayout    = LAYOUT_ROWS;
+
+  std::vector<float> vMapX;
+  std::vector<float> vMapY;
+
+  std::vector<float> vGain;
+  std::vector<float> vPlaneGain;
+
+  int iColorspace = COLORSPACE_BGR;
+  int iLevels     = 0;
+};
+
+/*********************************************************************
+*  gnomonic geometry of elphel sensors
+*
+**********************************************************************/
+
+/*! \brief Elphel geometry
+*
+* Geometry equivalent to the one used by lg_ttg_elphel, with calibrated
+* focal length and principal point.
+*
+* \param sD    Calibration data of the sensor
+* \param gG    Geometry filled with the calibration data
+*/
+
+void  elphelGeometry( const sensorData & sD,
+            gnomonicGeometry & gG ) ;
+
+/*! \brief Centered geometry
+*
+* Geometry equivalent to the one used by lg_ttg_center, with a given focal
+* length and the principal point at the center of the sensor image.
+*
+* \param sD      Calibration data of the sensor
+* \param focal   Focal length in mm
+* \param gG      Geometry filled with the calibration data
+*/
+
+void  centerGeometry( const sensorData & sD,
+            const double & focal,
+            gnomonicGeometry & gG ) ;
+
+/*! \brief Attitude correction
+*
+* Rotates the sensor rays of a geometry by the attitude of the camera for
+* one frame, so that the projection follows the orientation of the vehicle.
+* The attitude is composed with the calibrated rotation, the projection map
+* kernels are unchanged.
+*
+* \param fA    Attitude of the frame
+* \param gG    Geometry whose rotation is corrected
+*/
+
+void  attitudeGeometry( const frameAttitude & fA,
+            gnomonicGeometry & gG ) ;
+
+/*! \brief Reduced geometry
+*
+* Scales a geometry for sensor and EQR images reduced by a factor, each
+* reduced pixel covering a block of scale x scale pixels, as decoded by the
+* scaled DCT of libjpeg. The rays of the sensor pixels are unchanged.
+*
+* \param lfScale   Reduction factor
+* \param gG        Geometry scaled
+*/
+
+void  scaleGeometry( const double & lfScale,
+            gnomonicGeometry & gG ) ;
+
+/*********************************************************************
+*  rotation matrix
+*
+**********************************************************************/
+
+/*! \brief Rotation matrix
+*
+* Rotation from sensor frame to panorama frame, composed of the roll around
+* the optical axis, the elevation and the azimuth.
+*
+* \param lfAzimuth     Azimuth in panorama frame (in radian)
+* \param lfElevation   Elevation (in radian)
+* \param lfRoll        Roll around optical axis (in radian)
+* \param lfMatrix      Rotation matrix
+*/
+
+void  rotationMatrix( const double & lfAzimuth,
+            const double & lfElevation,
+            const double & lfRoll,
+            double lfMatrix[3][3] ) ;
+
+/*********************************************************************
+*  sensor to EQR coordinates
+*
+**********************************************************************/
+
+/*! \brief Sensor to EQR tile coordinates
+*
+* Declared static, so that each instruction set of the kernels gets its own
+* copy of the function.
+*
+* \param gG    Geometry of the projection
+* \param x     x coordinate in sensor image
+* \param y     y coordinate in sensor image
+* \param u     x coordinate in EQR tile
+* \param v     y coordinate in EQR tile
+*/
+
+static inline void  sensorToEqr( const gnomonicGeometry & gG,
+            const double & x,
+            const double & y,
+            double & u,
+            double & v )
+{
+    // ray in sensor frame
+    const double lfX = ( x - gG.lfpx0 ) * gG.lfPixelSize;
+    const double lfY = ( y - gG.lfpy0 ) * gG.lfPixelSize;
+    const double lfZ = gG.lfFocalLength;
+
+    // ray in panorama frame
+    const double lfXp = gG.lfMatrix[0][0] * lfX + gG.lfMatrix[0][1] * lfY + gG.lfMatrix[0][2] * lfZ;
+    const double lfYp = gG.lfMatrix[1][0] * lfX + gG.lfMatrix[1][1] * lfY + gG.lfMatrix[1][2] * lfZ;
+    const double lfZp = gG.lfMatrix[2][0] * lfX + gG.lfMatrix[2][1] * lfY + gG.lfMatrix[2][2] * lfZ;
+
+    // longitude in [0,2pi[ from the left of the panorama, latitude from the top
+    double lfLongitude = atan2( lfXp, lfZp );
+    if( lfLongitude < 0.0 )
+        lfLongitude += 2.0 * LG_PI;
+
+    const double lfLatitude = acos( - lfYp / sqrt( lfXp * lfXp + lfYp * lfYp + lfZp * lfZp ) );
+
+    // position in EQR tile
+    u = lfLongitude * ( gG.lfMapWidth / ( 2.0 * LG_PI ) ) - gG.lfCornerX;
+    v = lfLatitude  * ( gG.lfMapHeight / LG_PI ) - gG.lfCornerY;
+
+    if( u < 0.0 )
+        u += gG.lfMapWidth;
+}
+
+/*! \brief EQR tile to sensor coordinates
+*
+* Inverse of sensorToEqr : the position in the EQR tile gives a ray in the
+* panorama frame, rotated back in the sensor frame (the rotation matrix is
+* orthogonal) and intersected with the sensor plane.
+*
+* \param gG    Geometry of the projection
+* \param u     x coordinate in EQR tile
+* \param v     y coordinate in EQR tile
+* \param x     x coordinate in sensor image
+* \param y     y coordinate in sensor image
+*
+* \return false if the ray points behind the sensor, x and y are then unchanged
+*/
+
+static inline bool  eqrToSensor( const gnomonicGeometry & gG,
+            const double & u,
+            const double & v,
+            double & x,
+            double & y )
+{
+    // ray in panorama frame
+    const double lfLongitude = ( u + gG.lfCornerX ) * ( 2.0 * LG_PI / gG.lfMapWidth );
+    const double lfLatitude  = ( v + gG.lfCornerY ) * ( LG_PI / gG.lfMapHeight );
+
+    const double lfXp =   sin( lfLatitude ) * sin( lfLongitude );
+    const double lfYp = - cos( lfLatitude );
+    const double lfZp =   sin( lfLatitude ) * cos( lfLongitude );
+
+    // ray in sensor frame
+    const double lfX = gG.lfMatrix[0][0] * lfXp + gG.lfMatrix[1][0] * lfYp + gG.lfMatrix[2][0] * lfZp;
+    const double lfY = gG.lfMatrix[0][1] * lfXp + gG.lfMatrix[1][1] * lfYp + gG.lfMatrix[2][1] * lfZp;
+    const double lfZ = gG.lfMatrix[0][2] * lfXp + gG.lfMatrix[1][2] * lfYp + gG.lfMatrix[2][2] * lfZp;
+
+    if( !( lfZ > 0.0 ) )
+        return false;
+
+    // intersection with the sensor plane
+    const double lfScale = gG.lfFocalLength / ( lfZ * gG.lfPixelSize );
+
+    x = gG.lfpx0 + lfX * lfScale;
+    y = gG.lfpy0 + lfY * lfScale;
+
+    return true;
+}
+
+/*********************************************************************
+*  projection map
+*
+**********************************************************************/
+
+/*! \brief Projection map computation
+*
+* This function computes the EQR tile coordinates of each pixel of the
+* sensor image, with the kernel of the selected instruction set. In fast
+* math mode, the map is computed in single precision with polynomial
+* approximations of the trigonometric functions, the deviation from the
+* exact map staying below 0.01 pixel.
+*
+* \param gG         Geometry of the projection
+* \param iWidth     Width of sensor image
+* \param iHeight    Height of sensor image
+* \param pM         Map filled with EQR tile coordinates
+* \param bFastMath  Use the fast math mode
+*/
+
+void  computeMap( const gnomonicGeometry & gG,
+            const int & iWidth,
+            const int & iHeight,
+            projectionMap & pM,
+            const bool & bFastMath = false ) ;
+
+/*! \brief Sparse projection map computation
+*
+* This function computes the exact EQR tile coordinates on a grid of nodes,
+* the coordinates of the other pixels being interpolated bilinearly from the
+* grid when the map rows are read. The spacing starts at 64 pixels and is
+* halved until the deviation from the exact projection, measured at the
+* middle of the cells and of their edges, is below the threshold. When the
+* deviation stops decreasing, as around the poles, the search is abandoned
+* and the returned deviation exceeds the threshold.
+*
+* \param gG            Geometry of the projection
+* \param iWidth        Width of sensor image
+* \param iHeight       Height of sensor image
+* \param lfThreshold   Maximal deviation from the exact projection, in pixels
+* \param pM            Sparse map filled with EQR tile coordinates
+*
+* \return the deviation of the map from the exact projection, in pixels
+*/
+
+double  computeSparseMap( const gnomonicGeometry & gG,
+            const int & iWidth,
+            const int & iHeight,
+            const double & lfThreshold,
+            projectionMap & pM ) ;
+
+/*! \brief Composed projection map computation
+*
+* This function composes a warp of the sensor image, such as a lens
+* undistortion or a stereo rectification map, with the projection. Each
+* pixel of the warped image gets the exact EQR tile coordinates of the sensor
+* position the warp points to, so that the EQR tile is resampled once into
+* the final geometry. The map is dense.
+*
+* \param gG         Geometry of the projection
+* \param iWidth     Width of warped image
+* \param iHeight    Height of warped image
+* \param pWarpX     x coordinate in sensor image of each warped pixel, row major
+* \param pWarpY     y coordinate in sensor image of each warped pixel, row major
+* \param pM         Map filled with EQR tile coordinates
+*/
+
+void  composeMap( const gnomonicGeometry & gG,
+            const int & iWidth,
+            const int & iHeight,
+            const float * pWarpX,
+            const float * pWarpY,
+            projectionMap & pM ) ;
+
+/*********************************************************************
+*  projection map row
+*
+**********************************************************************/
+
+/*! \brief Row of a projection map
+*
+* Rows of a dense map are returned in place. Rows of a sparse map are
+* expanded in the buffers, interpolating the grid vertically at the ends of
+* each cell and then linearly along the cell. Declared static, so that each
+* instruction set of the kernels gets its own copy of the function.
+*
+* \param pM        Projection map
+* \param y         Row in sensor image
+* \param pBufferX  Buffer of iWidth elements for the x coordinates
+* \param pBufferY  Buffer of iWidth elements for the y coordinates
+* \param pX        x coordinates of the row
+* \param pY        y coordinates of the row
+*/
+
+static inline void  mapRow( const projectionMap & pM,
+            const int & y,
+            float * pBufferX,
+            float * pBufferY,
+            const float * & pX,
+            const float * & pY )
+{
+    if( pM.iStep == 0 )
+    {
+        pX = &pM.vMapX[ (size_t) y * pM.iWidth ];
+        pY = &pM.vMapY[ (size_t) y * pM.iWidth ];
+        return;
+    }
+
+    // grid rows around y
+    const int   iRow = y / pM.iStep;
+    const float lfInvStep = 1.0f / pM.iStep;
+    const float lfFy = ( y - iRow * pM.iStep ) * lfInvStep;
+
+    const float * pX0 = &pM.vMapX[ (size_t) iRow * pM.iGridWidth ];
+    const float * pY0 = &pM.vMapY[ (size_t) iRow * pM.iGridWidth ];
+    const float * pX1 = pX0 + pM.iGridWidth;
+    const float * pY1 = pY0 + pM.iGridWidth;
+
+    for( int c = 0; c * pM.iStep < pM.iWidth; ++c )
+    {
+        const float lfLeftX  = pX0[c]     + lfFy * ( pX1[c]     - pX0[c] );
+        const float lfLeftY  = pY0[c]     + lfFy * ( pY1[c]     - pY0[c] );
+        const float lfRightX = pX0[c + 1] + lfFy * ( pX1[c + 1] - pX0[c + 1] );
+        const float lfRightY = pY0[c + 1] + lfFy * ( pY1[c + 1] - pY0[c + 1] );
+
+        const float lfDx = ( lfRightX - lfLeftX ) * lfInvStep;
+        const float lfDy = ( lfRightY - lfLeftY ) * lfInvStep;
+
+        const int iStart = c * pM.iStep;
+        const int iCount = std::min( pM.iStep, pM.iWidth - iStart );
+
+        for( int k = 0; k < iCount; ++k )
+        {
+            pBufferX[ iStart + k ] = lfLeftX + k * lfDx;
+            pBufferY[ iStart + k ] = lfLeftY + k * lfDy;
+        }
+    }
+
+    // grid longitudes are unwrapped, bring them back in the panorama
+    const float lfWrap = pM.lfWrap;
+
+    for( int x = 0; x < pM.iWidth; ++x )
+    {
+        const float u = pBufferX[x];
+        pBufferX[x] = u >= lfWrap ? u - lfWrap : ( u < 0.0f ? u + lfWrap : u );
+    }
+
+    pX = pBufferX;
+    pY = pBufferY;
+}
+
+/*********************************************************************
+*  traversal of the sensor image
+*
+**********************************************************************/
+
+/*! \brief Traversal planning
+*
+* This function chooses how the resampling kernels traverse the sensor
+* image, from the Jacobian of the map at the center of the sensor. Tiles are
+* traversed along the sensor direction that stays closest to an EQR row, so
+* that consecutive samples share cache lines, and the tile side is the
+* largest power of two whose source footprint, for all frames, and map fit
+* in half of the L2 cache. When even the smallest tile overflows the cache
+* and the best direction crosses an EQR row every few samples, the EQR tile
+* is resampled from a blocked copy.
+*
+* \param pM            Projection map, updated with the traversal
+* \param iPixelBytes   Size of an EQR pixel, in bytes
+* \param iFrames       Number of frames resampled together
+*/
+
+void  planTraversal( projectionMap & pM,
+            const int & iPixelBytes,
+            const int & iFrames ) ;
+
+/*********************************************************************
+*  projection map deviation
+*
+**********************************************************************/
+
+/*! \brief Projection map deviation
+*
+* This function compares a projection map, dense or sparse, with the exact
+* projection, on every iStep pixel of every iStep row.
+*
+* \param gG      Geometry of the projection
+* \param pM      Projection map
+* \param iStep   Sampling step, in pixels
+*
+* \return the maximum distance between the map and the exact projection, in pixels
+*/
+
+double  mapDeviation( const gnomonicGeometry & gG,
+            const projectionMap & pM,
+            const int & iStep ) ;
+
+/*********************************************************************
+*  footprint of a sensor image in the EQR tile
+*
+**********************************************************************/
+
+/*! \brief EQR footprint
+*
+* This function computes the bounding box, in the EQR tile, of the positions
+* sampled by a sensor image, on a grid of 8 pixels and on the borders of the
+* image. Longitudes are unwrapped as in the projection maps, so that the box
+* of an image crossing the seam of the panorama extends beyond it.
+*
+* \param gG         Geometry of the projection
+* \param iWidth     Width of sensor image
+* \param iHeight    Height of sensor image
+* \param lfUMin     Smallest x coordinate in EQR tile
+* \param lfUMax     Largest x coordinate in EQR tile
+* \param lfVMin     Smallest y coordinate in EQR tile
+* \param lfVMax     Largest y coordinate in EQR tile
+*/
+
+void  eqrFootprint( const gnomonicGeometry & gG,
+            const int & iWidth,
+            const int & iHeight,
+            double & lfUMin,
+            double & lfUMax,
+            double & lfVMin,
+            double & lfVMax ) ;
+
+#endif
@@ -41,9 +41,16 @@
  */
 
 #include "tools.hpp"
+#include "jobs.hpp"
+#include "lease.hpp"
+#include "cluster.hpp"
+#include "kernels.hpp"
+#include "views.hpp"
 #include "../lib/stlplus3/filesystemSimplified/file_system.hpp"
 #include "../lib/cmdLine/cmdLine.h"
+#include <algorithm>
 #include <cstring>
+#include <unistd.h>
 
 using namespace std;
 using namespace cv;
@@ -95,12 +102,59 @@ using namespace cv;
 * This function takes a sensor as input and load all calibration
 * needed for gnomonic projection.
 *
-* \param input_image   Name of the EQR image you want to project
+* \param input_image   Name of the EQR image you want to project, or directory
+*                      containing the EQR images you want to project
 * \param output_directory  Complete path of the output directory where you want to put your images
 * \param mac_address   Mac address of the elphel camera that take the photo
 * \param mount_point   Mount point of the camera folder on your machine
 * \param focal         (optionnal) Focal length in mm that you want to use
 *                      for gnomonic projection with constant focal
+* \param shard         (optionnal) Shard i/N of the EQR images to project, used
+*                      to split a directory between N machines
+* \param claim_directory (optionnal) Directory shared by workers, where batches
+*                      of EQR images are claimed using lease files
+* \param lease_duration (optionnal) Duration of leases in seconds
+* \param batch_frames  (optionnal) Number of frames claimed at once
+* \param coordinator_port (optionnal) Port (1 to 65535) on which jobs are handed out to workers
+* \param coordinator   (optionnal) Coordinator address (host:port) to pull jobs from
+* \param luminance     (optionnal) Project the luminance plane only
+* \param raw           (optionnal) Project the planes of the EQR image as stored
+* \param interpolation (optionnal) Interpolation method : nearest, bilinear or bicubic
+* \param engine        (optionnal) Projection implementation : auto (libgnomonic for 8 bits BGR
+*                      tiles when the options allow it, kernels otherwise), kernel, gnomonic or opencv
+* \param isa           (optionnal) Instruction set of the kernels : auto, sse2,
+*                      avx2 or avx512
+* \param fastMath      (optionnal) Compute the projection map in single precision, and reproject
+*                      points with the vectorized single precision kernels
+* \param checkMap      (optionnal) Check the deviation of the projection map
+* \param gridMap       (optionnal) Sparse grid map with the given maximal deviation (in pixels)
+* \param channelFrames (optionnal) Number of frames of a channel resampled in one pass (default 4)
+* \param timing        (optionnal) Report the time spent in each stage of the projection
+* \param layout        (optionnal) Memory layout of the EQR tile : auto (default), rows, blocks or planes
+* \param panorama      (optionnal) Input images are full EQR panoramas, all channels of a frame are
+*                      projected from one decoded panorama
+* \param channels      (optionnal) Comma separated list of channels projected from panoramas
+* \param views         (optionnal) Render virtual views instead of sensor images : cube[:size],
+*                      ring:N[:size] or a JSON view set file
+* \param attitude      (optionnal) CSV file with the attitude of each frame (timestamp,roll,pitch,yaw
+*                      in degrees), composed with the calibrated orientation of the sensors
+* \param warp          (optionnal) Warp of the sensor images (dense map or camera model), applied in
+*                      the same resampling pass, see eqrToGnomonicFrames
+* \param photometric   (optionnal) Gains, flat field, vignetting and white balance applied to the
+*                      samples before they are stored, see eqrToGnomonicFrames
+* \param colorspace    (optionnal) Colorspace of the sensor images : bgr (default), gray, ycbcr444
+*                      or ycbcr420, converted by the kernels before the samples are stored
+* \param quality       (optionnal) JPEG quality of ycbcr420 sensor images (default 95)
+* \param pyramid       (optionnal) Number of reduced levels (1/2, 1/4, 1/8) written with each
+*                      sensor image, computed in the resampling pass
+* \param preview       (optionnal) Reduction factor 2, 4 or 8 : EQR images are decoded at reduced
+*                      size and projected in reduced sensor images, under the usual names
+* \param roi           (optionnal) Region of interest x,y,w,h of the sensor images, projected
+*                      alone from the region of the EQR tile it needs
+* \param points        (optionnal) CSV file of points channel,x,y reprojected from the sensor
+*                      images to the EQR panorama, without projecting any image
+* \param pointsOutput  (optionnal) CSV file of the reprojected points (default standard output)
+* \param eqrToSensor   (optionnal) Reproject points from the EQR panorama to the sensor images
 *
 * \return 0 if all was well, 1 in other cases.
 */
@@ -114,6 +168,30 @@ int main(int argc, char** argv) {
     std::string output_directory=""; // output directory
     std::string mac_address="";  //mac adress
     std::string mount_point="";  // mount point
+    std::string shard="";        // shard of the job list (i/N)
+    std::string claim_directory=""; // shared directory for lease files
+    double lease_duration = 600.0;  // lease duration (in s)
+    int    batch_frames = 1;        // number of frames claimed at once
+    int    coordinator_port = 0;    // coordinator mode port
+    std::string coordinator="";     // coordinator address (worker mode)
+    std::string interpolation="bicubic"; // interpolation method
+    std::string engine="auto";      // projection implementation
+    std::string isa="auto";         // instruction set of the kernels
+    std::string layout="auto";      // memory layout of the EQR tile
+    double grid_threshold = 0.0;    // maximal deviation of sparse grid map (in pixels)
+    int    channel_frames = 4;      // frames of a channel resampled in one pass
+    std::string channel_list="";    // channels projected from panoramas
+    std::string view_set="";        // virtual views rendered from panoramas
+    std::string attitude_file="";   // per-frame attitudes
+    std::string warp_file="";       // warp composed with the projection
+    std::string photometry_file=""; // photometric correction of the samples
+    std::string colorspace="bgr";   // colorspace of the sensor images
+    int    jpeg_quality = 95;       // JPEG quality of 4:2:0 sensor images
+    int    pyramid_levels = 0;      // reduced levels of the sensor images
+    int    preview_scale = 1;       // reduction factor of preview images
+    std::string roi="";             // region of interest of the sensor images
+    std::string points_file="";     // points reprojected without images
+    std::string points_output="";   // reprojected points
 
     // check is a focal length is given, and update method if necessary
     int  normalizedFocal(0);  // gnomonic projection method. 0 elphel method (default), 1 with constant focal
@@ -126,6 +204,37 @@ int main(int argc, char** argv) {
     cmd.add( make_option('m', mac_address, "macAddress") );
     cmd.add( make_option('d', mount_point, "mountPoint") );
     cmd.add( make_option('f', focal, "focal") );
+    cmd.add( make_option('s', shard, "shard") );
+    cmd.add( make_option('c', claim_directory, "claimDirectory") );
+    cmd.add( make_option('l', lease_duration, "lease") );
+    cmd.add( make_option('b', batch_frames, "batch") );
+    cmd.add( make_option('C', coordinator_port, "coordinator") );
+    cmd.add( make_option('w', coordinator, "worker") );
+    cmd.add( make_switch('y', "luminance") );
+    cmd.add( make_switch('r', "raw") );
+    cmd.add( make_option('I', interpolation, "interpolation") );
+    cmd.add( make_option('e', engine, "engine") );
+    cmd.add( make_option('x', isa, "isa") );
+    cmd.add( make_switch('F', "fastMath") );
+    cmd.add( make_switch('k', "checkMap") );
+    cmd.add( make_option('g', grid_threshold, "gridMap") );
+    cmd.add( make_option('K', channel_frames, "channelFrames") );
+    cmd.add( make_switch('t', "timing") );
+    cmd.add( make_option('L', layout, "layout") );
+    cmd.add( make_switch('p', "panorama") );
+    cmd.add( make_option('n', channel_list, "channels") );
+    cmd.add( make_option('v', view_set, "views") );
+    cmd.add( make_option('a', attitude_file, "attitude") );
+    cmd.add( make_option('W', warp_file, "warp") );
+    cmd.add( make_option('P', photometry_file, "photometric") );
+    cmd.add( make_option('Y', colorspace, "colorspace") );
+    cmd.add( make_option('q', jpeg_quality, "quality") );
+    cmd.add( make_option('M', pyramid_levels, "pyramid") );
+    cmd.add( make_option('S', preview_scale, "preview") );
+    cmd.add( make_option('R', roi, "roi") );
+    cmd.add( make_option('T', points_file, "points") );
+    cmd.add( make_option('O', points_output, "pointsOutput") );
+    cmd.add( make_switch('E', "eqrToSensor") );
 
     try {
       if (argc == 1) throw std::string("Invalid command line parameter.");
@@ -137,6 +246,37 @@ int main(int argc, char** argv) {
       << "[-o|--outputDirectory]\n"
       << "[-d|--mountPoint]\n"
       << "[-f|--focal] (in mm)\n"
+      << "[-s|--shard] i/N (project shard i of N)\n"
+      << "[-c|--claimDirectory] (shared directory for work claiming)\n"
+      << "[-l|--lease] (lease duration in s, default 600)\n"
+      << "[-b|--batch] (frames claimed at once, default 1)\n"
+      << "[-C|--coordinator] port (hand out jobs to workers)\n"
+      << "[-w|--worker] host:port (pull jobs from a coordinator)\n"
+      << "[-y|--luminance] (project luminance plane only)\n"
+      << "[-r|--raw] (project planes as stored, e.g. raw Bayer)\n"
+      << "[-I|--interpolation] nearest, bilinear or bicubic (default)\n"
+      << "[-e|--engine] auto (default, libgnomonic when possible), kernel, gnomonic (libgnomonic) or opencv (cv::remap)\n"
+      << "[-x|--isa] auto (default), sse2, avx2 or avx512\n"
+      << "[-F|--fastMath] (single precision projection map, or vectorized point reprojection)\n"
+      << "[-k|--checkMap] (fail if the map deviates by more than 0.01 pixel)\n"
+      << "[-g|--gridMap] (sparse grid map with given maximal deviation in pixels, e.g. 0.05)\n"
+      << "[-K|--channelFrames] (frames of a channel resampled in one pass, default 4)\n"
+      << "[-t|--timing] (report time spent reading, mapping, resampling and writing)\n"
+      << "[-L|--layout] auto (default), rows, blocks or planes (EQR tile memory layout)\n"
+      << "[-p|--panorama] (inputs are full EQR panoramas, decoded once per frame)\n"
+      << "[-n|--channels] list (channels projected from panoramas, e.g. 0,1,8, default all)\n"
+      << "[-v|--views] cube[:size], ring:N[:size] or view set file (render virtual views)\n"
+      << "[-a|--attitude] CSV file of timestamp,roll,pitch,yaw in degrees (per-frame attitude)\n"
+      << "[-W|--warp] file (undistortion or rectification map composed with the projection)\n"
+      << "[-P|--photometric] file (gain, flat field, vignetting and white balance correction)\n"
+      << "[-Y|--colorspace] bgr (default), gray, ycbcr444 or ycbcr420 (sensor image colorspace)\n"
+      << "[-q|--quality] (JPEG quality of ycbcr420 sensor images, default 95)\n"
+      << "[-M|--pyramid] levels (1 to 3, write 1/2, 1/4, 1/8 images with each sensor image)\n"
+      << "[-S|--preview] 2, 4 or 8 (decode and project at reduced size, use a separate output directory)\n"
+      << "[-R|--roi] x,y,w,h (project a region of interest of the sensor images)\n"
+      << "[-T|--points] CSV file of channel,x,y (reproject sensor points to the EQR panorama)\n"
+      << "[-O|--pointsOutput] CSV file of reprojected points (default standard output)\n"
+      << "[-E|--eqrToSensor] (reproject EQR panorama points to the sensor images)\n"
       << std::endl;
 
       std::cerr << s << std::endl;
@@ -157,8 +297,312 @@ int main(int argc, char** argv) {
       }
     }
 
-    // check if image dir exists
-    if ( !stlplus::file_exists( input_image ) )
+    // projection options
+    projectionOptions options;
+    if( cmd.used('y') && cmd.used('r') )
+    {
+      std::cerr << "\nOptions --luminance and --raw are exclusive" << std::endl;
+      return EXIT_FAILURE;
+    }
+    if( cmd.used('y') )
+      options.iPlanes = PLANES_LUMINANCE;
+    if( cmd.used('r') )
+      options.iPlanes = PLANES_RAW;
+
+    options.bFastMath = cmd.used('F');
+    options.bCheckMap = cmd.used('k');
+    options.bTiming   = cmd.used('t');
+
+    if( grid_threshold < 0.0 )
+    {
+      std::cerr << "\nGrid map deviation must be positive" << std::endl;
+      return EXIT_FAILURE;
+    }
+    options.lfGridThreshold = grid_threshold;
+
+    if( channel_frames < 1 )
+    {
+      std::cerr << "\nNumber of channel frames has to be positive" << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    if( interpolation == "nearest" )
+      options.iInterpolation = INTERPOLATION_NEAREST;
+    else if( interpolation == "bilinear" )
+      options.iInterpolation = INTERPOLATION_BILINEAR;
+    else if( interpolation == "bicubic" )
+      options.iInterpolation = INTERPOLATION_BICUBIC;
+    else
+    {
+      std::cerr << "\nUnknown interpolation method " << interpolation << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    if( engine == "auto" )
+      options.iEngine = ENGINE_AUTO;
+    else if( engine == "kernel" )
+      options.iEngine = ENGINE_KERNEL;
+    else if( engine == "gnomonic" )
+      options.iEngine = ENGINE_GNOMONIC;
+    else if( engine == "opencv" )
+      options.iEngine = ENGINE_OPENCV;
+    else
+    {
+      std::cerr << "\nUnknown projection engine " << engine << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    if( layout == "auto" )
+      options.iLayout = LAYOUT_AUTO;
+    else if( layout == "rows" )
+      options.iLayout = LAYOUT_ROWS;
+    else if( layout == "blocks" )
+      options.iLayout = LAYOUT_BLOCKS;
+    else if( layout == "planes" )
+      options.iLayout = LAYOUT_PLANES;
+    else
+    {
+      std::cerr << "\nUnknown memory layout " << layout << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    if( colorspace == "bgr" )
+      options.iColorspace = COLORSPACE_BGR;
+    else if( colorspace == "gray" )
+      options.iColorspace = COLORSPACE_GRAY;
+    else if( colorspace == "ycbcr444" )
+      options.iColorspace = COLORSPACE_YCBCR444;
+    else if( colorspace == "ycbcr420" )
+      options.iColorspace = COLORSPACE_YCBCR420;
+    else
+    {
+      std::cerr << "\nUnknown colorspace " << colorspace << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    if( jpeg_quality < 1 || jpeg_quality > 100 )
+    {
+      std::cerr << "\nJPEG quality must be between 1 and 100" << std::endl;
+      return EXIT_FAILURE;
+    }
+    options.iQuality = jpeg_quality;
+
+    if( options.iEngine == ENGINE_GNOMONIC && options.iInterpolation != INTERPOLATION_BICUBIC )
+    {
+      std::cerr << "\nThe gnomonic engine only supports bicubic interpolation" << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    // options of the projection map and of the kernels, not used by libgnomonic
+    if( options.iEngine == ENGINE_GNOMONIC && ( options.bFastMath || options.bCheckMap || options.lfGridThreshold > 0.0 || options.iLayout != LAYOUT_AUTO ) )
+    {
+      std::cerr << "\nOptions --fastMath, --checkMap, --gridMap and --layout are not available with the gnomonic engine" << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    // channels projected from full panoramas
+    const bool bPanorama = cmd.used('p');
+    std::vector<size_t> channels;
+
+    if( !channel_list.empty() && ( !bPanorama || !parseChannels( channel_list, channels ) ) )
+    {
+      std::cerr << "\nInvalid channel list " << channel_list << ", expected comma separated channels with --panorama" << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    // virtual views rendered from panoramas, without calibration
+    const bool bViews = !view_set.empty();
+    std::vector<virtualView> views;
+
+    if( bViews && bPanorama )
+    {
+      std::cerr << "\nOptions --views and --panorama are exclusive" << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    if( bViews && !loadViewSet( view_set, views ) )
+    {
+      std::cerr << "\nInvalid view set " << view_set << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    // colorspace converted by the kernels, from BGR planes
+    if( options.iColorspace != COLORSPACE_BGR && ( bViews || options.iEngine == ENGINE_GNOMONIC || options.iEngine == ENGINE_OPENCV || options.iPlanes != PLANES_COLOR ) )
+    {
+      std::cerr << "\nColorspace conversion is only available for BGR sensor images with the kernel engine" << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    // reduced levels, written next to each sensor image
+    if( pyramid_levels < 0 || pyramid_levels > 3 || ( pyramid_levels > 0 && bViews ) )
+    {
+      std::cerr << "\nPyramid levels must be between 0 and 3, and are not available with --views" << std::endl;
+      return EXIT_FAILURE;
+    }
+    options.iLevels = pyramid_levels;
+
+    // previews decoded and projected at reduced size
+    if( preview_scale != 1 && preview_scale != 2 && preview_scale != 4 && preview_scale != 8 )
+    {
+      std::cerr << "\nPreview scale must be 2, 4 or 8" << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    if( preview_scale > 1 && ( options.iPlanes == PLANES_RAW || options.iEngine == ENGINE_GNOMONIC || !warp_file.empty() ) )
+    {
+      std::cerr << "\nPreviews are not available with --raw, --warp nor with the gnomonic engine" << std::endl;
+      return EXIT_FAILURE;
+    }
+    options.iPreview = preview_scale;
+
+    // region of interest, decoded and projected alone
+    if( !roi.empty() )
+    {
+      if( bViews || preview_scale > 1 || options.iEngine == ENGINE_GNOMONIC || !warp_file.empty() || !photometry_file.empty() )
+      {
+        std::cerr << "\nRegions of interest are not available with --views, --preview, --warp, --photometric nor with the gnomonic engine" << std::endl;
+        return EXIT_FAILURE;
+      }
+
+      if( !parseRoi( roi, options ) )
+      {
+        std::cerr << "\nInvalid region of interest " << roi << ", expected x,y,w,h in pixels" << std::endl;
+        return EXIT_FAILURE;
+      }
+    }
+
+    // per-frame attitudes, composed with the calibration of each sensor
+    std::map<std::string, frameAttitude> attitudes;
+
+    if( !attitude_file.empty() )
+    {
+      if( bViews || options.iEngine == ENGINE_GNOMONIC )
+      {
+        std::cerr << "\nAttitude correction is not available with --views nor with the gnomonic engine" << std::endl;
+        return EXIT_FAILURE;
+      }
+
+      if( !loadAttitudes( attitude_file, attitudes ) )
+        return EXIT_FAILURE;
+
+      options.pAttitudes = &attitudes;
+    }
+
+    // warp of the sensor images, read with the calibration of each channel
+    if( !warp_file.empty() )
+    {
+      if( bViews || options.iEngine == ENGINE_GNOMONIC )
+      {
+        std::cerr << "\nWarps are not available with --views nor with the gnomonic engine" << std::endl;
+        return EXIT_FAILURE;
+      }
+
+      if( !stlplus::file_exists( warp_file ) )
+      {
+        std::cerr << "\nThe warp file doesn't exist" << std::endl;
+        return EXIT_FAILURE;
+      }
+
+      options.sWarp = warp_file;
+    }
+
+    // photometric correction, read with the calibration of each channel
+    if( !photometry_file.empty() )
+    {
+      if( bViews || options.iEngine == ENGINE_GNOMONIC )
+      {
+        std::cerr << "\nPhotometric correction is not available with --views nor with the gnomonic engine" << std::endl;
+        return EXIT_FAILURE;
+      }
+
+      if( !stlplus::file_exists( photometry_file ) )
+      {
+        std::cerr << "\nThe photometric correction file doesn't exist" << std::endl;
+        return EXIT_FAILURE;
+      }
+
+      options.sPhotometry = photometry_file;
+    }
+
+    // select the kernels matching the CPU, or the requested ones
+    if( !selectIsa( isa ) )
+    {
+      std::cerr << "\nInstruction set " << isa << " is unknown or not supported by this CPU" << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    // points reprojected with the calibration, without images
+    if( !points_file.empty() )
+    {
+      if( bViews || !warp_file.empty() || !attitude_file.empty() )
+      {
+        std::cerr << "\nPoint reprojection is not available with --views, --warp nor --attitude" << std::endl;
+        return EXIT_FAILURE;
+      }
+
+      if( mac_address.empty() || mount_point.empty() )
+      {
+        std::cerr << "\n No mac address or mount point given " << std::endl;
+        return EXIT_FAILURE;
+      }
+
+      return !reprojectPointFile( points_file, points_output, mount_point, mac_address, normalizedFocal, focal, cmd.used('E'), options );
+    }
+
+    // check shard specification
+    size_t shardIndex = 0;
+    size_t shardCount = 1;
+    if( !shard.empty() && !parseShard( shard, shardIndex, shardCount ) )
+    {
+      std::cerr << "\nInvalid shard " << shard << ", expected i/N with 0 <= i < N" << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    // check coordinator port
+    if( cmd.used('C') && ( coordinator_port < 1 || coordinator_port > 65535 ) )
+    {
+      std::cerr << "\nInvalid coordinator port " << coordinator_port << ", expected 1 to 65535" << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    // check claiming parameters
+    if( !claim_directory.empty() )
+    {
+      if( lease_duration <= 0.0 || batch_frames < 1 )
+      {
+        std::cerr << "\nLease duration and batch size have to be positive" << std::endl;
+        return EXIT_FAILURE;
+      }
+
+      if( !stlplus::folder_exists( claim_directory ) && !stlplus::folder_create( claim_directory ) )
+      {
+        std::cerr << "\nCannot create claim directory" << std::endl;
+        return EXIT_FAILURE;
+      }
+    }
+
+    // coordinator only needs the job manifest
+    if( coordinator_port > 0 )
+    {
+      std::vector<projectionJob> jobs;
+      if( !discoverJobs( input_image, jobs ) )
+      {
+        std::cerr << "\nNo EQR image to project" << std::endl;
+        return EXIT_FAILURE;
+      }
+
+      if( shardCount > 1 )
+      {
+        std::vector<projectionJob> shardedJobs;
+        shardJobs( jobs, shardIndex, shardCount, shardedJobs );
+        jobs.swap( shardedJobs );
+      }
+
+      return !runCoordinator( jobs, coordinator_port );
+    }
+
+    // check if image dir exists, workers get their images from the coordinator
+    if ( coordinator.empty() && !stlplus::file_exists( input_image ) && !stlplus::folder_exists( input_image ) )
     {
       std::cerr << "\nThe input image doesn't exist" << std::endl;
       return EXIT_FAILURE;
@@ -184,7 +628,7 @@ int main(int argc, char** argv) {
           else
           {
             // check if mac address is given
-            if( mac_address.empty() )
+            if( mac_address.empty() && !bViews )
             {
               std::cerr << "\n No mac address given " << std::endl;
               return EXIT_FAILURE;
@@ -192,7 +636,7 @@ int main(int argc, char** argv) {
             else
             {
               // check if mount point is given
-              if( mount_point.empty() )
+              if( mount_point.empty() && !bViews )
               {
                 std::cerr << "\n No mount point given " << std::endl;
                 return EXIT_FAILURE;
@@ -203,7 +647,7 @@ int main(int argc, char** argv) {
         else
         {
             // check if mac address is given
-            if( mac_address.empty() )
+            if( mac_address.empty() && !bViews )
             {
               std::cerr << "\n No mac address given " << std::endl;
               return EXIT_FAILURE;
@@ -211,7 +655,7 @@ int main(int argc, char** argv) {
             else
             {
               // check if mount point is given
-              if( mount_point.empty() )
+              if( mount_point.empty() && !bViews )
               {
                 std::cerr << "\n No mount point given " << std::endl;
                 return EXIT_FAILURE;
@@ -225,14 +669,164 @@ int main(int argc, char** argv) {
     }
 
     // do gnomonic projection
-    const bool  bProjected = eqrToGnomonic (
-          input_image,
-          output_directory,
-          mount_point,
-          mac_address,
-          normalizedFocal,
-          focal
-    );
+    const projectFunction projectImage = [&]( const std::string & image ) {
+      if( bViews )
+        return eqrToViews( image, views, output_directory, options );
+
+      if( bPanorama )
+        return eqrPanoramaToGnomonic( image, channels, output_directory, mount_point, mac_address, normalizedFocal, focal, options );
+
+      return eqrToGnomonic (
+            image,
+            output_directory,
+            mount_point,
+            mac_address,
+            normalizedFocal,
+            focal,
+            options
+      );
+    };
+
+    std::cerr << "Kernels compiled for " << isaName() << std::endl;
+
+    // pull EQR images from coordinator, images already projected are skipped
+    if( !coordinator.empty() )
+    {
+      const projectFunction projectMissing = [&]( const std::string & image ) {
+        return ( !bPanorama && !bViews && stlplus::file_exists( outputImageName( image, output_directory, normalizedFocal, outputImageSuffix( options ) ) ) )
+            || projectImage( image );
+      };
+
+      return !runWorker( coordinator, projectMissing, 30.0 );
+    }
+
+    // list EQR images to project
+    std::vector<projectionJob> jobs;
+    if( !discoverJobs( input_image, jobs ) )
+    {
+      std::cerr << "\nNo EQR image to project" << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    if( shardCount > 1 )
+    {
+      std::vector<projectionJob> shardedJobs;
+      shardJobs( jobs, shardIndex, shardCount, shardedJobs );
+      jobs.swap( shardedJobs );
+    }
+
+    // without claiming, all jobs form one batch
+    std::vector< std::vector<projectionJob> > batches;
+    if( claim_directory.empty() )
+      batches.push_back( jobs );
+    else
+      batchJobs( jobs, batch_frames, batches );
+
+    // shards may hold no frame, e.g. with more shards than frames
+    if( batches.empty() )
+      return EXIT_SUCCESS;
+
+    // in batch mode, images already projected are silently skipped
+    const bool bBatch = stlplus::folder_exists( input_image ) || !claim_directory.empty();
+    bool bProjected = true;
+
+    // workers start at different batches to limit contention on leases
+    const size_t firstBatch = claim_directory.empty() ? 0 : stableHash( workerName() ) % batches.size();
+
+    // batches are settled once done, or once they failed on this worker ; batches
+    // held by other workers are retried until they are done or their lease expires
+    std::vector<bool> settled( batches.size(), false );
+    size_t iPending = batches.size();
+
+    while( iPending > 0 )
+    {
+      bool bClaimed = false;
+
+      for( size_t k = 0; k < batches.size(); ++k )
+      {
+        const size_t iBatch = ( firstBatch + k ) % batches.size();
+        const std::vector<projectionJob> & batch = batches[iBatch];
+
+        if( settled[iBatch] )
+          continue;
+
+        jobLease lease;
+        if( !claim_directory.empty() )
+        {
+          if( batchDone( claim_directory, batchKey( batch ) ) )
+          {
+            settled[iBatch] = true;
+            --iPending;
+            continue;
+          }
+
+          if( !claimLease( claim_directory, batchKey( batch ), lease_duration, lease ) )
+            continue;
+        }
+
+        bClaimed = true;
+        bool bLeaseHeld = true;
+        bool bBatchProjected = true;
+
+        // frames of the same channel share one pass over their projection map,
+        // panoramas are projected one at a time
+        std::vector< std::vector<projectionJob> > groups;
+        if( bPanorama || bViews )
+          batchJobs( batch, 1, groups );
+        else
+          channelJobs( batch, channel_frames, groups );
+
+        for( size_t g = 0; g < groups.size(); ++g )
+        {
+          // stop if the lease was taken over by another worker
+          if( !claim_directory.empty() && !renewLease( lease ) )
+          {
+            std::cerr << "\nLease " << lease.sKey << " lost, batch abandoned" << std::endl;
+            bLeaseHeld = false;
+            break;
+          }
+
+          if( bPanorama || bViews )
+          {
+            bBatchProjected &= projectImage( groups[g].front().sInputImage );
+            continue;
+          }
+
+          std::vector<std::string> images;
+          for( size_t i = 0; i < groups[g].size(); ++i )
+          {
+            if( bBatch && stlplus::file_exists( outputImageName( groups[g][i].sInputImage, output_directory, normalizedFocal, outputImageSuffix( options ) ) ) )
+              continue;
+
+            images.push_back( groups[g][i].sInputImage );
+          }
+
+          if( !images.empty() )
+            bBatchProjected &= eqrToGnomonicFrames( images, output_directory, mount_point, mac_address, normalizedFocal, focal, options );
+        }
+
+        // a lost batch is waited for, its new holder completes or releases it
+        if( !bLeaseHeld )
+          continue;
+
+        // failed batches are not marked as done, other workers may retry them
+        if( !claim_directory.empty() )
+        {
+          if( bBatchProjected )
+            completeLease( lease );
+          else
+            releaseLease( lease );
+        }
+
+        bProjected &= bBatchProjected;
+        settled[iBatch] = true;
+        --iPending;
+      }
+
+      // all remaining batches are held by other workers, wait for their leases
+      if( iPending > 0 && !bClaimed )
+        usleep( std::min( lease_duration / 4.0, 30.0 ) * 1e6 );
+    }
 
     return !bProjected;
 }
@@ -0,0 +1,369 @@
+/*
+* gnoproj
+*
+* Copyright (c) 2013-2015 FOXEL SA - http://foxel.ch
+* Please read <http://foxel.ch/license> for more information.
+*
+*
+* Author(s):
+*
+*      Stéphane Flotron <s.flotron@foxel.ch>
+*
+* Contributor(s):
+*
+*      Luc Deschenaux <luc.deschenaux@foxel.ch>
+*
+*
+* This file is part of the FOXEL project <http://foxel.ch>.
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Affero General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Affero General Public License for more details.
+*
+* You should have received a copy of the GNU Affero General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*
+* Additional Terms:
+*
+*      You are required to preserve legal notices and author attributions in
+*      that material or in the Appropriate Legal Notices displayed by works
+*      containing it.
+*
+*      You are required to attribute the work as explained in the "Usage and
+*      Attribution" section of <http://foxel.ch/license>.
+*/
+
+#include "jobs.hpp"
+#include "tools.hpp"
+#include "../lib/stlplus3/filesystemSimplified/file_system.hpp"
+#include <algorithm>
+#include <iomanip>
+#include <map>
+#include <sstream>
+
+using namespace std;
+
+/*********************************************************************
+*  parse EQR image name
+*
+**********************************************************************/
+
+bool  parseImageName( const std::string & input_image,
+            std::string & sTimestamp,
+            size_t      & iChannel )
+{
+    // extract channel information from image name
+    std::vector<string>  splitted_name;
+
+    if( !split( stlplus::filename_part( input_image ), "-", splitted_name ) )
+        return false;
+
+    // the channel field is a sensor index, names like foo-EQR.tiff are rejected
+    char * pEnd = NULL;
+    const long lChannel = strtol( splitted_name[1].c_str(), &pEnd, 10 );
+    if( splitted_name[0].empty() || splitted_name[1].empty() || *pEnd != '\0' || lChannel < 0 )
+        return false;
+
+    sTimestamp = splitted_name[0];
+    iChannel   = lChannel;
+
+    return true;
+};
+
+/*********************************************************************
+*  check if a file is an EQR image
+*
+**********************************************************************/
+
+static bool  isEqrImage( const std::string & filename )
+{
+    const std::string sSuffix = "eqr.tiff";
+
+    if( filename.size() < sSuffix.size() )
+        return false;
+
+    std::string sEnd = filename.substr( filename.size() - sSuffix.size() );
+    std::transform( sEnd.begin(), sEnd.end(), sEnd.begin(), ::tolower );
+
+    return sEnd == sSuffix;
+}
+
+/*********************************************************************
+*  recursive search of EQR images
+*
+**********************************************************************/
+
+static void  searchEqrImages( const std::string & folder,
+            std::vector<std::string> & images )
+{
+    const std::vector<std::string> files = stlplus::folder_files( folder );
+    for( size_t i = 0; i < files.size(); ++i )
+    {
+        if( isEqrImage( files[i] ) )
+            images.push_back( stlplus::create_filespec( folder, files[i] ) );
+    }
+
+    const std::vector<std::string> subfolders = stlplus::folder_subdirectories( folder );
+    for( size_t i = 0; i < subfolders.size(); ++i )
+        searchEqrImages( stlplus::folder_down( folder, subfolders[i] ), images );
+}
+
+/*********************************************************************
+*  discover EQR images to project
+*
+**********************************************************************/
+
+static bool  jobOrder( const projectionJob & a, const projectionJob & b )
+{
+    if( a.sTimestamp != b.sTimestamp )
+        return a.sTimestamp < b.sTimestamp;
+    if( a.iChannel != b.iChannel )
+        return a.iChannel < b.iChannel;
+    return a.sInputImage < b.sInputImage;
+}
+
+bool  discoverJobs( const std::string & input,
+            std::vector<projectionJob> & jobs )
+{
+    std::vector<std::string> images;
+
+    jobs.clear();
+
+    if( stlplus::folder_exists( input ) )
+        searchEqrImages( input, images );
+    else if( stlplus::file_exists( input ) )
+        images.push_back( input );
+
+    for( size_t i = 0; i < images.size(); ++i )
+    {
+        projectionJob job;
+        job.sInputImage = images[i];
+
+        if( !parseImageName( job.sInputImage, job.sTimestamp, job.iChannel ) )
+        {
+            std::cerr << " Cannot parse image name " << job.sInputImage << ", skipped" << std::endl;
+            continue;
+        }
+
+        jobs.push_back( job );
+    }
+
+    std::sort( jobs.begin(), jobs.end(), jobOrder );
+
+    return !jobs.empty();
+};
+
+/*********************************************************************
+*  parse shard specification
+*
+**********************************************************************/
+
+bool  parseShard( const std::string & sShard,
+            size_t & iShardIndex,
+            size_t & iShardCount )
+{
+    std::vector<string>  splitted_shard;
+
+    if( !split( sShard, "/", splitted_shard ) || splitted_shard.size() != 2 )
+        return false;
+
+    char * pEnd = NULL;
+    const long lIndex = strtol( splitted_shard[0].c_str(), &pEnd, 10 );
+    if( splitted_shard[0].empty() || *pEnd != '\0' )
+        return false;
+
+    const long lCount = strtol( splitted_shard[1].c_str(), &pEnd, 10 );
+    if( splitted_shard[1].empty() || *pEnd != '\0' )
+        return false;
+
+    if( lCount < 1 || lIndex < 0 || lIndex >= lCount )
+        return false;
+
+    iShardIndex = lIndex;
+    iShardCount = lCount;
+
+    return true;
+};
+
+/*********************************************************************
+*  parse channel list
+*
+**********************************************************************/
+
+bool  parseChannels( const std::string & sChannels,
+            std::vector<size_t> & channels )
+{
+    std::vector<string>  splitted_channels;
+    split( sChannels, ",", splitted_channels );
+
+    channels.clear();
+
+    for( size_t i = 0; i < splitted_channels.size(); ++i )
+    {
+        char * pEnd = NULL;
+        const long lChannel = strtol( splitted_channels[i].c_str(), &pEnd, 10 );
+        if( splitted_channels[i].empty() || *pEnd != '\0' || lChannel < 0 )
+            return false;
+
+        if( std::find( channels.begin(), channels.end(), (size_t) lChannel ) == channels.end() )
+            channels.push_back( lChannel );
+    }
+
+    return true;
+};
+
+/*********************************************************************
+*  stable hash of a string
+*
+**********************************************************************/
+
+uint64_t  stableHash( const std::string & sValue )
+{
+    uint64_t hash = 14695981039346656037ULL;
+
+    for( size_t i = 0; i < sValue.size(); ++i )
+    {
+        hash ^= (unsigned char) sValue[i];
+        hash *= 1099511628211ULL;
+    }
+
+    return hash;
+};
+
+/*********************************************************************
+*  deterministic sharding of jobs
+*
+**********************************************************************/
+
+// rendezvous hashing : a frame goes to the shard with the highest hash of
+// the frame and shard, so that its shard only depends on its timestamp and
+// on the number of shards. The last FNV-1a rounds mix the shard index
+// poorly, the combined hashes go through the splitmix64 finalizer
+static uint64_t  mixHash( uint64_t iHash )
+{
+    iHash = ( iHash ^ ( iHash >> 30 ) ) * 0xbf58476d1ce4e5b9ULL;
+    iHash = ( iHash ^ ( iHash >> 27 ) ) * 0x94d049bb133111ebULL;
+
+    return iHash ^ ( iHash >> 31 );
+}
+
+static size_t  frameShard( const std::string & sTimestamp,
+            const size_t & iShardCount )
+{
+    const uint64_t iFrameHash = stableHash( sTimestamp );
+
+    size_t   iBest = 0;
+    uint64_t iBestHash = 0;
+
+    for( size_t k = 0; k < iShardCount; ++k )
+    {
+        const uint64_t iHash = mixHash( iFrameHash + 0x9e3779b97f4a7c15ULL * ( k + 1 ) );
+
+        if( k == 0 || iHash > iBestHash )
+        {
+            iBest     = k;
+            iBestHash = iHash;
+        }
+    }
+
+    return iBest;
+}
+
+void  shardJobs( const std::vector<projectionJob> & jobs,
+            const size_t & iShardIndex,
+            const size_t & iShardCount,
+            std::vector<projectionJob> & shard )
+{
+    // all channels of a frame share its timestamp, and so its shard
+    std::map<std::string, size_t> assignment;
+
+    shard.clear();
+    for( size_t i = 0; i < jobs.size(); ++i )
+    {
+        std::map<std::string, size_t>::const_iterator it = assignment.find( jobs[i].sTimestamp );
+
+        if( it == assignment.end() )
+            it = assignment.insert( std::make_pair( jobs[i].sTimestamp, frameShard( jobs[i].sTimestamp, iShardCount ) ) ).first;
+
+        if( it->second == iShardIndex )
+            shard.push_back( jobs[i] );
+    }
+};
+
+/*********************************************************************
+*  group jobs in batches of frames
+*
+**********************************************************************/
+
+void  batchJobs( const std::vector<projectionJob> & jobs,
+            const size_t & iFrames,
+            std::vector< std::vector<projectionJob> > & batches )
+{
+    size_t iFrameCount = 0;
+
+    batches.clear();
+    for( size_t i = 0; i < jobs.size(); ++i )
+    {
+        // a new frame starts
+        if( i == 0 || jobs[i].sTimestamp != jobs[i-1].sTimestamp )
+        {
+            if( iFrameCount % std::max( iFrames, (size_t) 1 ) == 0 )
+                batches.push_back( std::vector<projectionJob>() );
+            ++iFrameCount;
+        }
+
+        batches.back().push_back( jobs[i] );
+    }
+};
+
+/*********************************************************************
+*  name of a batch
+*
+**********************************************************************/
+
+std::string  batchKey( const std::vector<projectionJob> & batch )
+{
+    std::ostringstream content;
+    for( size_t i = 0; i < batch.size(); ++i )
+        content << batch[i].sTimestamp << "-" << batch[i].iChannel << ";";
+
+    std::ostringstream key;
+    key << ( batch.empty() ? std::string( "empty" ) : batch.front().sTimestamp )
+        << "-" << std::hex << std::setw( 16 ) << std::setfill( '0' ) << stableHash( content.str() );
+
+    return key.str();
+};
+
+/*********************************************************************
+*  group jobs by channel
+*
+**********************************************************************/
+
+void  channelJobs( const std::vector<projectionJob> & jobs,
+            const size_t & iFrames,
+            std::vector< std::vector<projectionJob> > & groups )
+{
+    // last open group of each channel
+    std::map<size_t, size_t> openGroup;
+
+    groups.clear();
+    for( size_t i = 0; i < jobs.size(); ++i )
+    {
+        std::map<size_t, size_t>::iterator it = openGroup.find( jobs[i].iChannel );
+
+        if( it == openGroup.end() || groups[it->second].size() >= std::max( iFrames, (size_t) 1 ) )
+        {
+            groups.push_back( std::vector<projectionJob>() );
+            openGroup[jobs[i].iChannel] = groups.size() - 1;
+        }
+
+        groups[openGroup[jobs[i].iChannel]].push_back( jobs[i] );
+    }
+};
@@ -0,0 +1,259 @@
+/*
+* gnoproj
+*
+* Copyright (c) 2013-2015 FOXEL SA - http://foxel.ch
+* Please read <http://foxel.ch/license> for more information.
+*
+*
+* Author(s):
+*
+*      Stéphane Flotron <s.flotron@foxel.ch>
+*
+* Contributor(s):
+*
+*      Luc Deschenaux <luc.deschenaux@foxel.ch>
+*
+*
+* This file is part of the FOXEL project <http://foxel.ch>.
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Affero General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Affero General Public License for more details.
+*
+* You should have received a copy of the GNU Affero General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*
+* Additional Terms:
+*
+*      You are required to preserve legal notices and author attributions in
+*      that material or in the Appropriate Legal Notices displayed by works
+*      containing it.
+*
+*      You are required to attribute the work as explained in the "Usage and
+*      Attribution" section of <http://foxel.ch/license>.
+*/
+
+  /*! \file jobs.hpp
+   * \author Stephane Flotron <s.flotron@foxel.ch>
+   */
+
+#ifndef JOBS_HPP_
+#define JOBS_HPP_
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+/******************************************************************************
+* projectionJob
+*****************************************************************************/
+
+/*! \struct projectionJob
+* \brief structure used to describe one EQR image to project
+*
+* \var projectionJob::sInputImage
+*  Complete path of the EQR image
+* \var projectionJob::sTimestamp
+*  Timestamp of the frame, shared by all channels of the frame
+* \var projectionJob::iChannel
+*  Sensor index of the elphel camera
+*/
+
+struct projectionJob
+{
+  std::string sInputImage = "";
+  std::string sTimestamp  = "";
+  size_t      iChannel    = 0;
+};
+
+/*********************************************************************
+*  parse EQR image name
+*
+**********************************************************************/
+
+/*! \brief EQR image name parsing
+*
+* This function extracts the frame timestamp and the sensor index from the
+* name of an EQR image (timestamp-channel-EQR.tiff).
+*
+* \param input_image   Name of the EQR image
+* \param sTimestamp    Timestamp of the frame
+* \param iChannel      Sensor index of the elphel camera
+*
+* \return bool value that says if the name could be parsed or not
+*/
+
+bool  parseImageName( const std::string & input_image,
+            std::string & sTimestamp,
+            size_t      & iChannel ) ;
+
+/*********************************************************************
+*  discover EQR images to project
+*
+**********************************************************************/
+
+/*! \brief Job discovery
+*
+* This function builds the list of projection jobs. If the input is a file,
+* a single job is created. If it is a directory, it is searched recursively
+* for EQR images (*EQR.tiff). Jobs are sorted by frame timestamp and channel,
+* so that every node of a cluster discovers the same job list.
+*
+* \param input   EQR image or directory containing EQR images
+* \param jobs    Vector filled with discovered jobs
+*
+* \return bool value that says if at least one job was found
+*/
+
+bool  discoverJobs( const std::string & input,
+            std::vector<projectionJob> & jobs ) ;
+
+/*********************************************************************
+*  parse shard specification
+*
+**********************************************************************/
+
+/*! \brief Shard specification parsing
+*
+* \param sShard       Shard specification given as i/N, with 0 <= i < N
+* \param iShardIndex  Index of the shard (i)
+* \param iShardCount  Number of shards (N)
+*
+* \return bool value that says if the specification is valid or not
+*/
+
+bool  parseShard( const std::string & sShard,
+            size_t & iShardIndex,
+            size_t & iShardCount ) ;
+
+/*********************************************************************
+*  parse channel list
+*
+**********************************************************************/
+
+/*! \brief Channel list parsing
+*
+* \param sChannels  Comma separated list of sensor indices, e.g. 0,1,8
+* \param channels   Vector filled with the listed channels, without duplicates
+*
+* \return bool value that says if the list is valid or not
+*/
+
+bool  parseChannels( const std::string & sChannels,
+            std::vector<size_t> & channels ) ;
+
+/*********************************************************************
+*  stable hash of a string
+*
+**********************************************************************/
+
+/*! \brief Stable string hash
+*
+* 64 bits FNV-1a hash. Unlike std::hash, its value does not depend on the
+* standard library or the machine, so it can be used to take decisions that
+* must be identical on every node of a cluster.
+*
+* \param sValue  The string to hash
+*
+* \return hash value
+*/
+
+uint64_t  stableHash( const std::string & sValue ) ;
+
+/*********************************************************************
+*  deterministic sharding of jobs
+*
+**********************************************************************/
+
+/*! \brief Job sharding
+*
+* This function splits a job list in iShardCount shards and returns the jobs
+* of shard iShardIndex. All channels of a frame are kept in the same shard.
+* Each frame is assigned by rendezvous hashing of its timestamp, to the shard
+* with the highest stable hash of the timestamp and shard index. The shard of
+* a frame does not depend on the other frames nor on the size of the files,
+* so that nodes started while images are still being copied get disjoint
+* shards, and every node covers its frames as they arrive. Shards are
+* balanced in number of frames, which is even across the shards on average.
+*
+* \param jobs         The complete job list
+* \param iShardIndex  Index of the shard to extract
+* \param iShardCount  Number of shards
+* \param shard        Vector filled with the jobs of the shard
+*/
+
+void  shardJobs( const std::vector<projectionJob> & jobs,
+            const size_t & iShardIndex,
+            const size_t & iShardCount,
+            std::vector<projectionJob> & shard ) ;
+
+/*********************************************************************
+*  group jobs in batches of frames
+*
+**********************************************************************/
+
+/*! \brief Job batching
+*
+* This function groups a job list, sorted as returned by discoverJobs, in
+* batches of iFrames consecutive frames. All channels of a frame are in the
+* same batch. The batches only depend on the job list and iFrames.
+*
+* \param jobs      The job list
+* \param iFrames   Number of frames per batch
+* \param batches   Vector filled with the batches
+*/
+
+void  batchJobs( const std::vector<projectionJob> & jobs,
+            const size_t & iFrames,
+            std::vector< std::vector<projectionJob> > & batches ) ;
+
+/*********************************************************************
+*  name of a batch
+*
+**********************************************************************/
+
+/*! rief Batch key
+*
+* This function names a batch after its content : the timestamp of its first
+* frame followed by a stable hash of the timestamp and channel of all its
+* jobs. Workers that built different batches, with another number of frames
+* per batch or from another state of the input directory, thus never share a
+* lease nor a completion mark.
+*
+* \param batch   The jobs of the batch
+*
+* 
+eturn key of the batch, used to name its lease files
+*/
+
+std::string  batchKey( const std::vector<projectionJob> & batch ) ;
+
+/*********************************************************************
+*  group jobs by channel
+*
+**********************************************************************/
+
+/*! \brief Channel grouping
+*
+* This function groups the jobs of a batch by channel, in groups of at most
+* iFrames consecutive frames of the same channel. The frames of a group share
+* their calibration, so that they can be projected with one pass over the
+* projection map. Channels keep the order of their first job.
+*
+* \param jobs      The job list
+* \param iFrames   Maximal number of frames per group
+* \param groups    Vector filled with the groups
+*/
+
+void  channelJobs( const std::vector<projectionJob> & jobs,
+            const size_t & iFrames,
+            std::vector< std::vector<projectionJob> > & groups ) ;
+
+#endif
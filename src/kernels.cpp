@@ -0,0 +1,236 @@
+/*
+* gnoproj
+*
+* Copyright (c) 2013-2015 FOXEL SA - http://foxel.ch
+* Please read <http://foxel.ch/license> for more information.
+*
+*
+* Author(s):
+*
+*      Stéphane Flotron <s.flotron@foxel.ch>
+*
+* Contributor(s):
+*
+*      Luc Deschenaux <luc.deschenaux@foxel.ch>
+*
+*
+* This file is part of the FOXEL project <http://foxel.ch>.
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Affero General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Affero General Public License for more details.
+*
+* You should have received a copy of the GNU Affero General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*
+* Additional Terms:
+*
+*      You are required to preserve legal notices and author attributions in
+*      that material or in the Appropriate Legal Notices displayed by works
+*      containing it.
+*
+*      You are required to attribute the work as explained in the "Usage and
+*      Attribution" section of <http://foxel.ch/license>.
+*/
+
+#include "kernels.hpp"
+
+using namespace std;
+
+/* kernels compiled for each instruction set, see kernels_impl.hpp */
+namespace isa_default {
+    extern const resampleFunction kernelTable[3][3][3][3];
+    void computeMap( const gnomonicGeometry &, const int &, const int &, projectionMap & );
+    void computeMapFast( const gnomonicGeometry &, const int &, const int &, projectionMap & );
+    void sensorToEqrPoints( const gnomonicGeometry &, const double *, const size_t &, double * );
+    void eqrToSensorPoints( const gnomonicGeometry &, const double *, const size_t &, double * );
+    void sensorToEqrPointsFast( const gnomonicGeometry &, const double *, const size_t &, double * );
+    void eqrToSensorPointsFast( const gnomonicGeometry &, const double *, const size_t &, double * );
+}
+
+#ifdef GNOPROJ_X86_KERNELS
+namespace isa_avx2 {
+    extern const resampleFunction kernelTable[3][3][3][3];
+    void computeMap( const gnomonicGeometry &, const int &, const int &, projectionMap & );
+    void computeMapFast( const gnomonicGeometry &, const int &, const int &, projectionMap & );
+    void sensorToEqrPoints( const gnomonicGeometry &, const double *, const size_t &, double * );
+    void eqrToSensorPoints( const gnomonicGeometry &, const double *, const size_t &, double * );
+    void sensorToEqrPointsFast( const gnomonicGeometry &, const double *, const size_t &, double * );
+    void eqrToSensorPointsFast( const gnomonicGeometry &, const double *, const size_t &, double * );
+}
+
+namespace isa_avx512 {
+    extern const resampleFunction kernelTable[3][3][3][3];
+    void computeMap( const gnomonicGeometry &, const int &, const int &, projectionMap & );
+    void computeMapFast( const gnomonicGeometry &, const int &, const int &, projectionMap & );
+    void sensorToEqrPoints( const gnomonicGeometry &, const double *, const size_t &, double * );
+    void eqrToSensorPoints( const gnomonicGeometry &, const double *, const size_t &, double * );
+    void sensorToEqrPointsFast( const gnomonicGeometry &, const double *, const size_t &, double * );
+    void eqrToSensorPointsFast( const gnomonicGeometry &, const double *, const size_t &, double * );
+}
+#endif
+
+/*********************************************************************
+*  instruction set selection
+*
+**********************************************************************/
+
+static int  selectedIsa = -1;
+
+static bool  isaSupported( const int & iIsa )
+{
+    switch( iIsa )
+    {
+        case ISA_DEFAULT :
+            return true;
+#ifdef GNOPROJ_X86_KERNELS
+        case ISA_AVX2 :
+            return __builtin_cpu_supports( "avx2" ) && __builtin_cpu_supports( "fma" );
+        case ISA_AVX512 :
+            return __builtin_cpu_supports( "avx512f" )  && __builtin_cpu_supports( "avx512bw" )
+                && __builtin_cpu_supports( "avx512dq" ) && __builtin_cpu_supports( "avx512vl" );
+#endif
+    }
+
+    return false;
+}
+
+bool  selectIsa( const std::string & sIsa )
+{
+    if( sIsa == "auto" )
+    {
+        selectedIsa = ISA_DEFAULT;
+        if( isaSupported( ISA_AVX2 ) )
+            selectedIsa = ISA_AVX2;
+        if( isaSupported( ISA_AVX512 ) )
+            selectedIsa = ISA_AVX512;
+        return true;
+    }
+
+    int iIsa = -1;
+    if( sIsa == "sse2" || sIsa == "default" )
+        iIsa = ISA_DEFAULT;
+    else if( sIsa == "avx2" )
+        iIsa = ISA_AVX2;
+    else if( sIsa == "avx512" )
+        iIsa = ISA_AVX512;
+
+    if( iIsa < 0 || !isaSupported( iIsa ) )
+        return false;
+
+    selectedIsa = iIsa;
+    return true;
+};
+
+std::string  isaName( )
+{
+    if( selectedIsa < 0 )
+        selectIsa( "auto" );
+
+    switch( selectedIsa )
+    {
+        case ISA_AVX2   : return "avx2";
+        case ISA_AVX512 : return "avx512";
+    }
+
+#ifdef GNOPROJ_X86_KERNELS
+    return "sse2";
+#else
+    return "default";
+#endif
+};
+
+/*********************************************************************
+*  kernel dispatch
+*
+**********************************************************************/
+
+resampleFunction  selectKernel( const int & iDepth,
+            const int & iChannels,
+            const int & iInterpolation,
+            const int & iLayout )
+{
+    int iDepthIndex = -1;
+    switch( iDepth )
+    {
+        case CV_8U  : iDepthIndex = 0; break;
+        case CV_16U : iDepthIndex = 1; break;
+        case CV_32F : iDepthIndex = 2; break;
+    }
+
+    int iPlaneIndex = -1;
+    switch( iChannels )
+    {
+        case 1 : iPlaneIndex = 0; break;
+        case 3 : iPlaneIndex = 1; break;
+        case 4 : iPlaneIndex = 2; break;
+    }
+
+    const int iLayoutIndex = iLayout - LAYOUT_ROWS;
+
+    if( iDepthIndex < 0 || iPlaneIndex < 0 || iInterpolation < 0 || iInterpolation > INTERPOLATION_BICUBIC )
+        return NULL;
+
+    if( iLayoutIndex < 0 || iLayoutIndex > LAYOUT_PLANES - LAYOUT_ROWS )
+        return NULL;
+
+    if( selectedIsa < 0 )
+        selectIsa( "auto" );
+
+    switch( selectedIsa )
+    {
+#ifdef GNOPROJ_X86_KERNELS
+        case ISA_AVX2   : return isa_avx2::kernelTable[iDepthIndex][iPlaneIndex][iInterpolation][iLayoutIndex];
+        case ISA_AVX512 : return isa_avx512::kernelTable[iDepthIndex][iPlaneIndex][iInterpolation][iLayoutIndex];
+#endif
+    }
+
+    return isa_default::kernelTable[iDepthIndex][iPlaneIndex][iInterpolation][iLayoutIndex];
+};
+
+mapFunction  selectMapKernel( const bool & bFastMath )
+{
+    if( selectedIsa < 0 )
+        selectIsa( "auto" );
+
+    switch( selectedIsa )
+    {
+#ifdef GNOPROJ_X86_KERNELS
+        case ISA_AVX2   : return bFastMath ? isa_avx2::computeMapFast : isa_avx2::computeMap;
+        case ISA_AVX512 : return bFastMath ? isa_avx512::computeMapFast : isa_avx512::computeMap;
+#endif
+    }
+
+    return bFastMath ? isa_default::computeMapFast : isa_default::computeMap;
+};
+
+pointFunction  selectPointKernel( const bool & bToSensor, const bool & bFastMath )
+{
+    if( selectedIsa < 0 )
+        selectIsa( "auto" );
+
+    switch( selectedIsa )
+    {
+#ifdef GNOPROJ_X86_KERNELS
+        case ISA_AVX2   :
+            if( bFastMath )
+                return bToSensor ? isa_avx2::eqrToSensorPointsFast : isa_avx2::sensorToEqrPointsFast;
+            return bToSensor ? isa_avx2::eqrToSensorPoints : isa_avx2::sensorToEqrPoints;
+        case ISA_AVX512 :
+            if( bFastMath )
+                return bToSensor ? isa_avx512::eqrToSensorPointsFast : isa_avx512::sensorToEqrPointsFast;
+            return bToSensor ? isa_avx512::eqrToSensorPoints : isa_avx512::sensorToEqrPoints;
+#endif
+    }
+
+    if( bFastMath )
+        return bToSensor ? isa_default::eqrToSensorPointsFast : isa_default::sensorToEqrPointsFast;
+    return bToSensor ? isa_default::eqrToSensorPoints : isa_default::sensorToEqrPoints;
+};
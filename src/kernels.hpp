@@ -0,0 +1,139 @@
+/*
+* gnoproj
+*
+* Copyright (c) 2013-2015 FOXEL SA - http://foxel.ch
+* Please read <http://foxel.ch/license> for more information.
+*
+*
+* Author(s):
+*
+*      Stéphane Flotron <s.flotron@foxel.ch>
+*
+* Contributor(s):
+*
+*      Luc Deschenaux <luc.deschenaux@foxel.ch>
+*
+*
+* This file is part of the FOXEL project <http://foxel.ch>.
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Affero General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Affero General Public License for more details.
+*
+* You should have received a copy of the GNU Affero General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*
+* Additional Terms:
+*
+*      You are required to preserve legal notices and author attributions in
+*      that material or in the Appropriate Legal Notices displayed by works
+*      containing it.
+*
+*      You are required to attribute the work as explained in the "Usage and
+*      Attribution" section of <http://foxel.ch/license>.
+*/
+
+  /*! \file kernels.hpp
+   * \author Stephane Flotron <s.flotron@foxel.ch>
+   */
+
+#ifndef KERNELS_HPP_
+#define KERNELS_HPP_
+
+#include "geometry.hpp"
+#include <string>
+
+/*********************************************************************
+*  kernel dispatch
+*
+**********************************************************************/
+
+/*! \brief Resampling kernel */
+typedef void ( * resampleFunction )( const std::vector<cv::Mat> &, const projectionMap &, std::vector<cv::Mat> & );
+
+/*! \brief Projection map kernel */
+typedef void ( * mapFunction )( const gnomonicGeometry &, const int &, const int &, projectionMap & );
+
+/*! \brief Point reprojection kernel */
+typedef void ( * pointFunction )( const gnomonicGeometry &, const double *, const size_t &, double * );
+
+/*! \enum instructionSet
+* \brief instruction sets the kernels are compiled for
+*/
+
+enum instructionSet
+{
+  ISA_DEFAULT, /*!< baseline of the target, SSE2 on x86-64 */
+  ISA_AVX2,    /*!< AVX2 and FMA */
+  ISA_AVX512   /*!< AVX-512 F, BW, DQ and VL */
+};
+
+/*! \brief Instruction set selection
+*
+* This function selects the kernels used by selectKernel and computeMap.
+* With "auto", the best instruction set supported by the CPU is selected.
+*
+* \param sIsa   Instruction set : auto, sse2, avx2 or avx512
+*
+* \return bool value that says if the instruction set is supported or not
+*/
+
+bool  selectIsa( const std::string & sIsa ) ;
+
+/*! \brief Name of the selected instruction set */
+std::string  isaName( ) ;
+
+/*! \brief Kernel selection
+*
+* This function returns the kernel instantiation matching the depth and the
+* number of planes of the EQR tile, the interpolation method and the memory
+* layout of the EQR tile, compiled for the selected instruction set.
+*
+* \param iDepth           Depth of the EQR tile (CV_8U, CV_16U or CV_32F)
+* \param iChannels        Number of planes of the EQR tile (1, 3 or 4)
+* \param iInterpolation   Interpolation method (see interpolationMethod)
+* \param iLayout          Memory layout of the EQR tile (see sourceLayout, not LAYOUT_AUTO)
+*
+* \return the kernel, or NULL if there is no kernel for these parameters
+*/
+
+resampleFunction  selectKernel( const int & iDepth,
+            const int & iChannels,
+            const int & iInterpolation,
+            const int & iLayout = LAYOUT_ROWS ) ;
+
+/*! \brief Projection map kernel selection
+*
+* \param bFastMath   Use single precision and polynomial approximations
+*
+* \return the projection map kernel compiled for the selected instruction set
+*/
+
+mapFunction  selectMapKernel( const bool & bFastMath ) ;
+
+/*! \brief Point reprojection kernel selection
+*
+* The kernels read and write interleaved (x,y) coordinates of iCount points,
+* in parallel. Points of the EQR tile that are behind the sensor are
+* projected to NaN coordinates. The exact kernels evaluate sensorToEqr and
+* eqrToSensor in double precision through libm, and are scalar for every
+* instruction set. The fast kernels use single precision and the polynomials
+* of fastmath.hpp, and are vectorized (0.002 pixel at most on a 16384 pixels
+* wide panorama).
+*
+* \param bToSensor   Project EQR tile coordinates to sensor coordinates
+* \param bFastMath   Use single precision and polynomial approximations
+*
+* \return the point reprojection kernel compiled for the selected instruction set
+*/
+
+pointFunction  selectPointKernel( const bool & bToSensor, const bool & bFastMath = false ) ;
+
+#endif
@@ -0,0 +1,66 @@
+/*
+* gnoproj
+*
+* Copyright (c) 2013-2015 FOXEL SA - http://foxel.ch
+* Please read <http://foxel.ch/license> for more information.
+*
+*
+* Author(s):
+*
+*      Stéphane Flotron <s.flotron@foxel.ch>
+*
+* Contributor(s):
+*
+*      Luc Deschenaux <luc.deschenaux@foxel.ch>
+*
+*
+* This file is part of the FOXEL project <http://foxel.ch>.
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Affero General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Affero General Public License for more details.
+*
+* You should have received a copy of the GNU Affero General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*
+* Additional Terms:
+*
+*      You are required to preserve legal notices and author attributions in
+*      that material or in the Appropriate Legal Notices displayed by works
+*      containing it.
+*
+*      You are required to attribute the work as explained in the "Usage and
+*      Attribution" section of <http://foxel.ch/license>.
+*/
+
+/* projection kernels compiled for AVX2 and FMA
+ *
+ * The instruction set is enabled by a target pragma after the headers, not by
+ * compiler flags : the inline functions of the standard library and OpenCV
+ * instantiated here are merged at link time with the copies of the other
+ * files, and have to stay compiled for the baseline instruction set. */
+#include "kernels.hpp"
+#include "fastmath.hpp"
+
+#if defined( __clang__ )
+#pragma clang attribute push( __attribute__(( target( "avx2,fma" ) )), apply_to = function )
+#else
+#pragma GCC push_options
+#pragma GCC target( "avx2,fma" )
+#endif
+
+#define GNOPROJ_ISA isa_avx2
+#include "kernels_impl.hpp"
+
+#if defined( __clang__ )
+#pragma clang attribute pop
+#else
+#pragma GCC pop_options
+#endif
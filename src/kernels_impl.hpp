@@ -0,0 +1,1106 @@
+/*
+* gnoproj
+*
+* Copyright (c) 2013-2015 FOXEL SA - http://foxel.ch
+* Please read <http://foxel.ch/license> for more information.
+*
+*
+* Author(s):
+*
+*      Stéphane Flotron <s.flotron@foxel.ch>
+*
+* Contributor(s):
+*
+*      Luc Deschenaux <luc.deschenaux@foxel.ch>
+*
+*
+* This file is part of the FOXEL project <http://foxel.ch>.
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Affero General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Affero General Public License for more details.
+*
+* You should have received a copy of the GNU Affero General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*
+* Additional Terms:
+*
+*      You are required to preserve legal notices and author attributions in
+*      that material or in the Appropriate Legal Notices displayed by works
+*      containing it.
+*
+*      You are required to attribute the work as explained in the "Usage and
+*      Attribution" section of <http://foxel.ch/license>.
+*/
+
+  /*! \file kernels_impl.hpp
+   * \author Stephane Flotron <s.flotron@foxel.ch>
+   *
+   * Projection kernels. This file is included once per instruction set by
+   * kernels_<isa>.cpp, with GNOPROJ_ISA defined to the namespace of the
+   * instruction set and the instruction set enabled by a target pragma. The
+   * namespace keeps the kernels of each instruction set apart, but not the
+   * inline functions of the standard library and OpenCV they instantiate,
+   * which are merged across files at link time : those are compiled for the
+   * baseline instruction set, the pragma applying only to the functions
+   * defined in this file.
+   */
+
+#include "kernels.hpp"
+#include "fastmath.hpp"
+#include <cmath>
+#include <algorithm>
+
+namespace GNOPROJ_ISA {
+
+/*********************************************************************
+*  interpolation weights
+*
+**********************************************************************/
+
+/*! \brief Bicubic weights
+*
+* Weights of the four samples surrounding a position, using the cubic
+* convolution kernel with a = -0.5.
+*
+* \param t   Fractional part of the position, in [0,1[
+* \param w   Weights of samples at -1, 0, 1 and 2
+*/
+
+inline void  cubicWeights( const float t, float w[4] )
+{
+    const float t2 = t * t;
+    const float t3 = t2 * t;
+
+    w[0] = -0.5f * t3 +        t2 - 0.5f * t;
+    w[1] =  1.5f * t3 - 2.5f * t2 + 1.0f;
+    w[2] = -1.5f * t3 + 2.0f * t2 + 0.5f * t;
+    w[3] =  0.5f * t3 - 0.5f * t2;
+}
+
+/*! \brief Index clamped to [0,iSize-1] */
+inline int  clampIndex( const int i, const int iSize )
+{
+    return std::min( std::max( i, 0 ), iSize - 1 );
+}
+
+/*********************************************************************
+*  memory layouts of the EQR tile
+*
+**********************************************************************/
+
+/*! \struct rowSource
+* \brief EQR tile accessed in place, in the row major layout of cv::Mat
+*
+* Sources give the address of a sample as the sum of a row and a column
+* term, so that the interpolation methods clamp and compute them once per
+* row and column of their footprint.
+*/
+
+template <typename T, int C>
+struct rowSource
+{
+    typedef T value_type;
+
+    const uchar * pData;
+    size_t        iStep;
+    int           iRows;
+    int           iCols;
+
+    explicit rowSource( const cv::Mat & eqr_img )
+        : pData( eqr_img.data ), iStep( eqr_img.step ), iRows( eqr_img.rows ), iCols( eqr_img.cols ) {}
+
+    inline const T * row( const int y ) const { return (const T *) ( pData + y * iStep ); }
+    inline int  column( const int x ) const { return x * C; }
+
+    inline int  clampRow( const int y ) const { return clampIndex( y, iRows ); }
+    inline int  clampColumn( const int x ) const { return clampIndex( x, iCols ); }
+};
+
+/*! \struct blockedSource
+* \brief Copy of the EQR tile in blocks of 8x8 pixels
+*
+* Blocks are stored contiguously, block rows one after the other, so that
+* the footprint of a bicubic sample spans one or two blocks instead of four
+* image rows. The address stays the sum of a row and a column term.
+*/
+
+template <typename T, int C>
+struct blockedSource
+{
+    typedef T value_type;
+
+    enum { BITS = 3, SIDE = 1 << BITS, MASK = SIDE - 1 };
+
+    std::vector<T> vData;
+    size_t         iBlockRow;
+    int            iRows;
+    int            iCols;
+
+    explicit blockedSource( const cv::Mat & eqr_img )
+        : iBlockRow( (size_t) ( ( eqr_img.cols + MASK ) >> BITS ) * SIDE * SIDE * C ),
+          iRows( eqr_img.rows ), iCols( eqr_img.cols )
+    {
+        vData.resize( iBlockRow * ( ( iRows + MASK ) >> BITS ) );
+
+        #pragma omp parallel for schedule(static)
+        for( int y = 0; y < iRows; ++y )
+        {
+            const T * pIn  = eqr_img.ptr<T>( y );
+            T *       pOut = const_cast<T *>( row( y ) );
+
+            for( int x = 0; x < iCols; ++x )
+                for( int c = 0; c < C; ++c )
+                    pOut[ column( x ) + c ] = pIn[ x * C + c ];
+        }
+    }
+
+    inline const T * row( const int y ) const { return &vData[0] + ( y >> BITS ) * iBlockRow + ( y & MASK ) * SIDE * C; }
+    inline int  column( const int x ) const { return ( ( ( x >> BITS ) << ( 2 * BITS ) ) + ( x & MASK ) ) * C; }
+
+    inline int  clampRow( const int y ) const { return clampIndex( y, iRows ); }
+    inline int  clampColumn( const int x ) const { return clampIndex( x, iCols ); }
+};
+
+/*! \struct interiorSource
+* \brief Source of any layout, for samples whose footprint is inside the tile
+*
+* Used for the tiles of the sensor image whose samples all fall inside the
+* EQR tile, so that the interpolation methods skip the clamping of indices.
+*/
+
+template <typename S>
+struct interiorSource
+{
+    const S & src;
+    int       iRows;
+    int       iCols;
+
+    explicit interiorSource( const S & source ) : src( source ), iRows( source.iRows ), iCols( source.iCols ) {}
+
+    inline const typename S::value_type * row( const int y ) const { return src.row( y ); }
+    inline int  column( const int x ) const { return src.column( x ); }
+
+    inline int  clampRow( const int y ) const { return y; }
+    inline int  clampColumn( const int x ) const { return x; }
+};
+
+/*********************************************************************
+*  interpolation methods
+*
+**********************************************************************/
+
+/*! \struct nearestInterpolation
+* \brief nearest neighbour sampling of the EQR tile
+*/
+
+struct nearestInterpolation
+{
+    // footprint, in samples before and after the integer position
+    enum { BEFORE = 0, AFTER = 1 };
+
+    template <typename T, int C, typename S>
+    static inline void sample( const S & src, const float u, const float v, float lfValue[C] )
+    {
+        const T * pPixel = src.row( src.clampRow( floor( v + 0.5f ) ) )
+                         + src.column( src.clampColumn( floor( u + 0.5f ) ) );
+
+        for( int c = 0; c < C; ++c )
+            lfValue[c] = pPixel[c];
+    }
+};
+
+/*! \struct bilinearInterpolation
+* \brief bilinear sampling of the EQR tile
+*/
+
+struct bilinearInterpolation
+{
+    // footprint, in samples before and after the integer position
+    enum { BEFORE = 0, AFTER = 1 };
+
+    template <typename T, int C, typename S>
+    static inline void sample( const S & src, const float u, const float v, float lfValue[C] )
+    {
+        const int ix = floor( u );
+        const int iy = floor( v );
+        const float fx = u - ix;
+        const float fy = v - iy;
+
+        const T * pRow0 = src.row( src.clampRow( iy     ) );
+        const T * pRow1 = src.row( src.clampRow( iy + 1 ) );
+        const int iCol0 = src.column( src.clampColumn( ix     ) );
+        const int iCol1 = src.column( src.clampColumn( ix + 1 ) );
+
+        for( int c = 0; c < C; ++c )
+        {
+            const float lfTop    = pRow0[iCol0 + c] + fx * ( pRow0[iCol1 + c] - pRow0[iCol0 + c] );
+            const float lfBottom = pRow1[iCol0 + c] + fx * ( pRow1[iCol1 + c] - pRow1[iCol0 + c] );
+            lfValue[c] = lfTop + fy * ( lfBottom - lfTop );
+        }
+    }
+};
+
+/*! \struct bicubicInterpolation
+* \brief bicubic sampling of the EQR tile
+*/
+
+struct bicubicInterpolation
+{
+    // footprint, in samples before and after the integer position
+    enum { BEFORE = 1, AFTER = 2 };
+
+    template <typename T, int C, typename S>
+    static inline void sample( const S & src, const float u, const float v, float lfValue[C] )
+    {
+        const int ix = floor( u );
+        const int iy = floor( v );
+
+        float wx[4], wy[4];
+        cubicWeights( u - ix, wx );
+        cubicWeights( v - iy, wy );
+
+        // clamped sample positions
+        const T * pRows[4];
+        int       iCols[4];
+        for( int k = 0; k < 4; ++k )
+        {
+            pRows[k] = src.row( src.clampRow( iy + k - 1 ) );
+            iCols[k] = src.column( src.clampColumn( ix + k - 1 ) );
+        }
+
+        for( int c = 0; c < C; ++c )
+        {
+            lfValue[c] = 0.0f;
+            for( int j = 0; j < 4; ++j )
+            {
+                const T * pRow = pRows[j] + c;
+                lfValue[c] += wy[j] * ( wx[0] * pRow[iCols[0]] + wx[1] * pRow[iCols[1]]
+                                      + wx[2] * pRow[iCols[2]] + wx[3] * pRow[iCols[3]] );
+            }
+        }
+    }
+};
+
+/*********************************************************************
+*  colorspace of the stored samples
+*
+**********************************************************************/
+
+/*! \brief Chroma offset of depth T, the middle of its range */
+template <typename T>
+inline float  chromaOffset() { return 128.0f; }
+
+template <>
+inline float  chromaOffset<unsigned short>() { return 32768.0f; }
+
+template <>
+inline float  chromaOffset<float>() { return 0.5f; }
+
+/*! \brief Planes of the stored samples
+*
+* \param C             Planes of the EQR tile
+* \param iColorspace   Colorspace of the sensor image (see outputColorspace)
+*
+* \return number of planes stored per pixel, 4:2:0 samples being stored as
+* 4:4:4 before subsampling
+*/
+
+inline int  storedPlanes( const int C,
+            const int iColorspace )
+{
+    if( iColorspace == COLORSPACE_GRAY )
+        return 1;
+    if( iColorspace == COLORSPACE_BGR )
+        return C;
+    return 3;
+}
+
+/*! \brief Colorspace conversion at the store
+*
+* Stores the luma, and for YCbCr the chroma, of a BGR sample, with the BT.601
+* full range coefficients of JPEG.
+*
+* \param lfValue       BGR sample (first three planes)
+* \param pOut          Output pixel
+* \param iColorspace   Colorspace of the sensor image (see outputColorspace)
+*/
+
+template <typename T, int C>
+inline void  storeColor( const float lfValue[C],
+            T * pOut,
+            const int iColorspace )
+{
+    const float lfB = lfValue[0];
+    const float lfG = lfValue[ C > 1 ? 1 : 0 ];
+    const float lfR = lfValue[ C > 2 ? 2 : 0 ];
+
+    const float lfLuma = 0.299f * lfR + 0.587f * lfG + 0.114f * lfB;
+
+    pOut[0] = cv::saturate_cast<T>( lfLuma );
+
+    if( iColorspace != COLORSPACE_GRAY )
+    {
+        pOut[1] = cv::saturate_cast<T>( ( lfB - lfLuma ) * 0.564f + chromaOffset<T>() );
+        pOut[2] = cv::saturate_cast<T>( ( lfR - lfLuma ) * 0.713f + chromaOffset<T>() );
+    }
+}
+
+/*! \brief Chroma subsampling of a tile
+*
+* Copies the luma of a 4:4:4 tile in the luma plane of a 4:2:0 sensor image,
+* and averages the chroma of its blocks of 2x2 pixels in the chroma planes.
+* The sensor image stores the luma plane in its first rows, followed by the
+* Cb and Cr planes side by side. Tiles start on even rows and columns.
+*
+* \param pTile     YCbCr 4:4:4 samples of the tile, iCount pixels per row
+* \param iRows     Rows of the tile
+* \param iCount    Columns of the tile
+* \param iHeight   Height of the luma plane
+* \param iFirst    First row of the tile in the sensor image
+* \param x         First column of the tile in the sensor image
+* \param out       4:2:0 sensor image
+*/
+
+template <typename T>
+inline void  subsampleTile( const T * pTile,
+            const int iRows,
+            const int iCount,
+            const int iHeight,
+            const int iFirst,
+            const int x,
+            cv::Mat & out )
+{
+    for( int r = 0; r < iRows; ++r )
+    {
+        T * pLuma = out.ptr<T>( iFirst + r ) + x;
+        const T * pRow = pTile + (size_t) r * iCount * 3;
+
+        for( int c = 0; c < iCount; ++c )
+            pLuma[c] = pRow[ c * 3 ];
+    }
+
+    const int iHalf = out.cols / 2;
+
+    for( int r = 0; r + 1 < iRows; r += 2 )
+    {
+        T * pChroma = out.ptr<T>( iHeight + ( iFirst + r ) / 2 ) + x / 2;
+        const T * p0 = pTile + (size_t) r * iCount * 3;
+        const T * p1 = p0 + (size_t) iCount * 3;
+
+        for( int c = 0; c + 1 < iCount; c += 2 )
+        {
+            pChroma[ c / 2 ]         = cv::saturate_cast<T>( ( (float) p0[ c * 3 + 1 ] + p0[ c * 3 + 4 ] + p1[ c * 3 + 1 ] + p1[ c * 3 + 4 ] ) * 0.25f );
+            pChroma[ iHalf + c / 2 ] = cv::saturate_cast<T>( ( (float) p0[ c * 3 + 2 ] + p0[ c * 3 + 5 ] + p1[ c * 3 + 2 ] + p1[ c * 3 + 5 ] ) * 0.25f );
+        }
+    }
+}
+
+/*********************************************************************
+*  reduced levels of the sensor images
+*
+**********************************************************************/
+
+/*! \brief Box filtered reduction of a region
+*
+* Averages the blocks of 2x2 pixels of a region of an image, and stores them
+* in a region of the image reduced by two. Blocks cut by the border of the
+* region are dropped.
+*
+* \param src       Image, with P planes
+* \param iRow      First row of the region in the image
+* \param iCol      First column of the region in the image
+* \param iRows     Rows of the region
+* \param iCols     Columns of the region
+* \param dst       Reduced image
+* \param iDstRow   First row of the reduced region
+* \param iDstCol   First column of the reduced region
+*/
+
+template <typename T, int P>
+inline void  reduceRegion( const cv::Mat & src,
+            const int iRow,
+            const int iCol,
+            const int iRows,
+            const int iCols,
+            cv::Mat & dst,
+            const int iDstRow,
+            const int iDstCol )
+{
+    for( int r = 0; r + 1 < iRows; r += 2 )
+    {
+        const T * p0 = src.ptr<T>( iRow + r ) + (size_t) iCol * P;
+        const T * p1 = src.ptr<T>( iRow + r + 1 ) + (size_t) iCol * P;
+        T * pOut = dst.ptr<T>( iDstRow + r / 2 ) + (size_t) iDstCol * P;
+
+        for( int c = 0; c < iCols / 2; ++c )
+        {
+            for( int p = 0; p < P; ++p )
+            {
+                const int i = 2 * c * P + p;
+                pOut[ c * P + p ] = cv::saturate_cast<T>( ( (float) p0[i] + p0[ i + P ] + p1[i] + p1[ i + P ] ) * 0.25f );
+            }
+        }
+    }
+}
+
+/*! \brief Box filtered reduction of a region, planes known at run time */
+template <typename T>
+inline void  reduceRegion( const cv::Mat & src,
+            const int iRow,
+            const int iCol,
+            const int iRows,
+            const int iCols,
+            const int iPlanes,
+            cv::Mat & dst,
+            const int iDstRow,
+            const int iDstCol )
+{
+    if( iPlanes == 1 )
+        reduceRegion<T, 1>( src, iRow, iCol, iRows, iCols, dst, iDstRow, iDstCol );
+    else if( iPlanes == 3 )
+        reduceRegion<T, 3>( src, iRow, iCol, iRows, iCols, dst, iDstRow, iDstCol );
+    else
+        reduceRegion<T, 4>( src, iRow, iCol, iRows, iCols, dst, iDstRow, iDstCol );
+}
+
+/*! \brief Reduced levels of a tile
+*
+* Reduces a tile of a sensor image, while it is in cache, in each level of
+* the pyramid, every level being reduced from the previous one. 4:2:0 levels
+* are reduced plane by plane. Tiles start on rows and columns that are
+* multiple of 2^(iLevels + 1).
+*
+* \param out_imgs  Sensor images, followed by their levels (see projectionMap::iLevels)
+* \param k         Frame of the tile
+* \param iFrames   Number of frames
+* \param pM        Projection map
+* \param iPlanes   Planes of each pixel of the sensor images
+* \param iFirst    First row of the tile
+* \param iRows     Rows of the tile
+* \param x         First column of the tile
+* \param iCount    Columns of the tile
+*/
+
+template <typename T>
+inline void  reduceTile( std::vector<cv::Mat> & out_imgs,
+            const size_t k,
+            const size_t iFrames,
+            const projectionMap & pM,
+            const int iPlanes,
+            int iFirst,
+            int iRows,
+            int x,
+            int iCount )
+{
+    const bool bSubsampled = pM.iColorspace == COLORSPACE_YCBCR420;
+
+    for( int l = 1; l <= pM.iLevels; ++l )
+    {
+        const cv::Mat & src = out_imgs[ ( l - 1 ) * iFrames + k ];
+        cv::Mat & dst = out_imgs[ l * iFrames + k ];
+
+        reduceRegion<T>( src, iFirst, x, iRows, iCount, iPlanes, dst, iFirst / 2, x / 2 );
+
+        if( bSubsampled )
+        {
+            // chroma planes follow the luma plane, Cb and Cr side by side
+            const int iSrcHeight = src.rows * 2 / 3;
+            const int iDstHeight = dst.rows * 2 / 3;
+
+            reduceRegion<T>( src, iSrcHeight + iFirst / 2, x / 2, iRows / 2, iCount / 2, 1, dst, iDstHeight + iFirst / 4, x / 4 );
+            reduceRegion<T>( src, iSrcHeight + iFirst / 2, src.cols / 2 + x / 2, iRows / 2, iCount / 2, 1, dst, iDstHeight + iFirst / 4, dst.cols / 2 + x / 4 );
+        }
+
+        iFirst /= 2;
+        x      /= 2;
+        iRows  /= 2;
+        iCount /= 2;
+    }
+}
+
+/*********************************************************************
+*  resampling of EQR tile
+*
+**********************************************************************/
+
+/*! \brief Run resampling
+*
+* This function resamples the EQR tile at iCount positions along a row or a
+* column of the sensor image, and stores the samples at the native depth of
+* the tile. Depth, number of planes and interpolation method are template
+* parameters, so that the interpolation is inlined and the plane loops are
+* unrolled.
+*
+* \param src          EQR tile, of depth T with C planes, in the layout of S
+* \param pX           x coordinates in EQR tile
+* \param pY           y coordinates in EQR tile
+* \param iMapStride   Distance between consecutive coordinates, in elements
+* \param iCount       Number of samples
+* \param pOut         Output samples, interleaved
+* \param iOutStride   Distance between consecutive output pixels, in elements
+* \param pGain        Gain of each sample, with the stride of the map, or NULL
+* \param pPlaneGain   Gain of each plane, or NULL
+* \param iColorspace  Colorspace of the stored samples (see outputColorspace)
+*/
+
+template <typename T, int C, typename I, typename S>
+inline void  resampleRun( const S & src,
+            const float * pX,
+            const float * pY,
+            const size_t iMapStride,
+            const int iCount,
+            T * pOut,
+            const size_t iOutStride,
+            const float * pGain = NULL,
+            const float * pPlaneGain = NULL,
+            const int iColorspace = COLORSPACE_BGR )
+{
+    if( !pGain && !pPlaneGain && iColorspace == COLORSPACE_BGR )
+    {
+        for( int x = 0; x < iCount; ++x )
+        {
+            float lfValue[C];
+            I::template sample<T, C>( src, pX[ x * iMapStride ], pY[ x * iMapStride ], lfValue );
+
+            for( int c = 0; c < C; ++c )
+                pOut[ x * iOutStride + c ] = cv::saturate_cast<T>( lfValue[c] );
+        }
+    }
+    else
+    {
+        // photometric correction and colorspace conversion before the
+        // store, missing gains being one
+        static const float lfUnit[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+
+        const float * pG = pGain ? pGain : lfUnit;
+        const size_t iGainStride = pGain ? iMapStride : 0;
+        const float * pP = pPlaneGain ? pPlaneGain : lfUnit;
+
+        for( int x = 0; x < iCount; ++x )
+        {
+            float lfValue[C];
+            I::template sample<T, C>( src, pX[ x * iMapStride ], pY[ x * iMapStride ], lfValue );
+
+            const float lfGain = pG[ x * iGainStride ];
+
+            for( int c = 0; c < C; ++c )
+                lfValue[c] *= lfGain * pP[c];
+
+            if( iColorspace == COLORSPACE_BGR )
+            {
+                for( int c = 0; c < C; ++c )
+                    pOut[ x * iOutStride + c ] = cv::saturate_cast<T>( lfValue[c] );
+            }
+            else
+                storeColor<T, C>( lfValue, pOut + x * iOutStride, iColorspace );
+        }
+    }
+}
+
+/*! \brief Tile resampling
+*
+* This function resamples a tile of the sensor image, traversed by rows or
+* by columns. Rows of the tile map are iMapStep elements apart.
+*
+* \param src          EQR tile, of depth T with C planes, in the layout of S
+* \param pX           x coordinates of the first sample of the tile
+* \param pY           y coordinates of the first sample of the tile
+* \param iMapStep     Distance between rows of the map, in elements
+* \param iRows        Rows of the tile
+* \param iCount       Columns of the tile
+* \param bColumns     Traverse the tile by columns
+* \param pOut         First output pixel of the tile
+* \param iOutStep     Distance between rows of the output, in elements
+* \param pGain        Gain of the first sample of the tile, with the stride of the map, or NULL
+* \param pPlaneGain   Gain of each plane, or NULL
+* \param iColorspace  Colorspace of the stored samples (see outputColorspace)
+*/
+
+template <typename T, int C, typename I, typename S>
+inline void  resampleTile( const S & src,
+            const float * pX,
+            const float * pY,
+            const size_t iMapStep,
+            const int iRows,
+            const int iCount,
+            const bool bColumns,
+            T * pOut,
+            const size_t iOutStep,
+            const float * pGain,
+            const float * pPlaneGain,
+            const int iColorspace )
+{
+    const int iPlanes = storedPlanes( C, iColorspace );
+
+    if( !bColumns )
+    {
+        for( int r = 0; r < iRows; ++r )
+            resampleRun<T, C, I>( src, pX + r * iMapStep, pY + r * iMapStep, 1, iCount, pOut + r * iOutStep, iPlanes,
+                pGain ? pGain + r * iMapStep : NULL, pPlaneGain, iColorspace );
+    }
+    else
+    {
+        // sensor columns follow the rows of the EQR tile
+        for( int c = 0; c < iCount; ++c )
+            resampleRun<T, C, I>( src, pX + c, pY + c, iMapStep, iRows, pOut + c * iPlanes, iOutStep,
+                pGain ? pGain + c : NULL, pPlaneGain, iColorspace );
+    }
+}
+
+/*! \brief Interior tile test
+*
+* \param pX           x coordinates of the first sample of the tile
+* \param pY           y coordinates of the first sample of the tile
+* \param iMapStep     Distance between rows of the map, in elements
+* \param iRows        Rows of the tile
+* \param iCount       Columns of the tile
+* \param iEqrRows     Rows of the EQR tile
+* \param iEqrCols     Columns of the EQR tile
+*
+* \return true if the footprints of all samples, for the interpolation I, are
+* inside the EQR tile
+*/
+
+template <typename I>
+inline bool  interiorTile( const float * pX,
+            const float * pY,
+            const size_t iMapStep,
+            const int iRows,
+            const int iCount,
+            const int iEqrRows,
+            const int iEqrCols )
+{
+    // floor( u ) - BEFORE >= 0 and floor( u ) + AFTER <= iEqrCols - 1, as
+    // bounds of u itself
+    const float lfMinX = I::BEFORE, lfEndX = iEqrCols - I::AFTER;
+    const float lfMinY = I::BEFORE, lfEndY = iEqrRows - I::AFTER;
+
+    bool bInterior = true;
+
+    for( int r = 0; r < iRows; ++r )
+    {
+        const float * pRowX = pX + r * iMapStep;
+        const float * pRowY = pY + r * iMapStep;
+
+        // every sample is compared, so that a NaN coordinate anywhere fails
+        // the test (std::min and std::max would drop it)
+        for( int c = 0; c < iCount; ++c )
+            bInterior &= ( pRowX[c] >= lfMinX ) & ( pRowX[c] < lfEndX )
+                       & ( pRowY[c] >= lfMinY ) & ( pRowY[c] < lfEndY );
+    }
+
+    return bInterior;
+}
+
+/*! \brief Sources resampling
+*
+* This function resamples EQR tiles of the same channel at the coordinates
+* given by the projection map. The map is traversed by square tiles, sized
+* and oriented by planTraversal, each tile being applied to all frames while
+* it is in cache, so that the map is streamed from memory once for the whole
+* group. Samples outside of an EQR tile are clamped to its border. The gains
+* of the map, if any, are applied before the samples are stored, in the
+* colorspace of the map. 4:2:0 tiles are resampled in a per thread 4:4:4
+* buffer, subsampled while it is in cache. The reduced levels of the map, if
+* any, are computed from each tile right after it is stored.
+*
+* \param eqr_imgs     EQR tiles, of depth T with C planes, accessed through S
+* \param pM           Projection map
+* \param pPlaneGains  C gains per EQR tile, or NULL
+* \param out_imgs     Sensor images, of the size of the map and the type of the tiles
+*/
+
+template <typename T, int C, typename I, typename S>
+void  resampleSources( const std::vector<cv::Mat> & eqr_imgs,
+            const projectionMap & pM,
+            const float * pPlaneGains,
+            std::vector<cv::Mat> & out_imgs )
+{
+    // EQR tiles in the memory layout of the source
+    std::vector<S> sources;
+    for( size_t k = 0; k < eqr_imgs.size(); ++k )
+        sources.push_back( S( eqr_imgs[k] ) );
+
+    // tiles of the map are applied to all frames while they are in cache,
+    // along with the footprint of the tile in each EQR tile
+    const int iTile   = pM.iTile > 0 ? pM.iTile : 64;
+    const int iBlocks = ( pM.iHeight + iTile - 1 ) / iTile;
+
+    const int  iPlanes     = storedPlanes( C, pM.iColorspace );
+    const bool bSubsampled = pM.iColorspace == COLORSPACE_YCBCR420;
+
+    #pragma omp parallel
+    {
+        // rows of sparse maps are expanded in per thread buffers, with the
+        // same stride as dense maps
+        std::vector<float> vBufferX( pM.iStep ? (size_t) pM.iWidth * iTile : 0 );
+        std::vector<float> vBufferY( pM.iStep ? (size_t) pM.iWidth * iTile : 0 );
+
+        std::vector<const float *> pX( iTile );
+        std::vector<const float *> pY( iTile );
+
+        std::vector<T> vTile( bSubsampled ? (size_t) iTile * iTile * 3 : 0 );
+
+        #pragma omp for schedule(static)
+        for( int b = 0; b < iBlocks; ++b )
+        {
+            const int iFirst = b * iTile;
+            const int iRows  = std::min( iTile, pM.iHeight - iFirst );
+
+            for( int r = 0; r < iRows; ++r )
+                mapRow( pM, iFirst + r, vBufferX.data() + (size_t) r * pM.iWidth, vBufferY.data() + (size_t) r * pM.iWidth, pX[r], pY[r] );
+
+            for( int x = 0; x < pM.iWidth; x += iTile )
+            {
+                const int iCount = std::min( iTile, pM.iWidth - x );
+
+                // tiles whose samples fall inside the EQR tiles skip clamping
+                const bool bInterior = interiorTile<I>( pX[0] + x, pY[0] + x, pM.iWidth, iRows, iCount, sources[0].iRows, sources[0].iCols );
+
+                // gains are dense, with the stride of the map rows
+                const float * pGain = pM.vGain.empty() ? NULL : pM.vGain.data() + (size_t) iFirst * pM.iWidth + x;
+
+                for( size_t k = 0; k < eqr_imgs.size(); ++k )
+                {
+                    T * pOut = bSubsampled ? vTile.data() : out_imgs[k].ptr<T>( iFirst ) + x * iPlanes;
+                    const size_t iOutStep = bSubsampled ? (size_t) iCount * 3 : out_imgs[k].step / sizeof( T );
+                    const float * pPlaneGain = pPlaneGains ? pPlaneGains + k * C : NULL;
+
+                    if( bInterior )
+                        resampleTile<T, C, I>( interiorSource<S>( sources[k] ), pX[0] + x, pY[0] + x, pM.iWidth, iRows, iCount, pM.bColumns, pOut, iOutStep, pGain, pPlaneGain, pM.iColorspace );
+                    else
+                        resampleTile<T, C, I>( sources[k], pX[0] + x, pY[0] + x, pM.iWidth, iRows, iCount, pM.bColumns, pOut, iOutStep, pGain, pPlaneGain, pM.iColorspace );
+
+                    if( bSubsampled )
+                        subsampleTile<T>( vTile.data(), iRows, iCount, pM.iHeight, iFirst, x, out_imgs[k] );
+
+                    if( pM.iLevels > 0 )
+                        reduceTile<T>( out_imgs, k, eqr_imgs.size(), pM, bSubsampled ? 1 : iPlanes, iFirst, iRows, x, iCount );
+                }
+            }
+        }
+    }
+}
+
+/*! \brief Frames resampling
+*
+* This function resamples EQR tiles of the same channel, see resampleSources,
+* with the plane gains of the map applied to every frame.
+*
+* \param eqr_imgs   EQR tiles, of depth T with C planes, accessed through S
+* \param pM         Projection map
+* \param out_imgs   Sensor images, of the size of the map and the type of the tiles
+*/
+
+template <typename T, int C, typename I, typename S>
+void  resampleFrames( const std::vector<cv::Mat> & eqr_imgs,
+            const projectionMap & pM,
+            std::vector<cv::Mat> & out_imgs )
+{
+    std::vector<float> vPlaneGains;
+    for( size_t k = 0; k < eqr_imgs.size() && !pM.vPlaneGain.empty(); ++k )
+        vPlaneGains.insert( vPlaneGains.end(), pM.vPlaneGain.begin(), pM.vPlaneGain.end() );
+
+    resampleSources<T, C, I, S>( eqr_imgs, pM, vPlaneGains.empty() ? NULL : vPlaneGains.data(), out_imgs );
+}
+
+/*! \brief Planar frames resampling
+*
+* This function deinterleaves the EQR tiles in planes, resamples all planes
+* of all frames with the single plane kernel in one pass over the map, and
+* interleaves the resampled planes in the sensor images. Each plane is then
+* gathered and stored contiguously, without strides of C samples, at the cost
+* of computing the interpolation weights once per plane. Colorspace
+* conversions need all planes of a sample, and reduced levels the
+* interleaved tiles, they fall back to the row layout.
+*
+* \param eqr_imgs   EQR tiles, of depth T with C planes
+* \param pM         Projection map
+* \param out_imgs   Sensor images, of the size of the map and the type of the tiles
+*/
+
+template <typename T, int C, typename I>
+void  resamplePlanes( const std::vector<cv::Mat> & eqr_imgs,
+            const projectionMap & pM,
+            std::vector<cv::Mat> & out_imgs )
+{
+    if( pM.iColorspace != COLORSPACE_BGR || pM.iLevels > 0 )
+    {
+        resampleFrames< T, C, I, rowSource< T, C > >( eqr_imgs, pM, out_imgs );
+        return;
+    }
+
+    std::vector<cv::Mat> eqr_planes;
+    std::vector<cv::Mat> out_planes;
+    std::vector<float>   plane_gains;
+
+    for( size_t k = 0; k < eqr_imgs.size(); ++k )
+    {
+        std::vector<cv::Mat> planes;
+        cv::split( eqr_imgs[k], planes );
+
+        for( int c = 0; c < C; ++c )
+        {
+            eqr_planes.push_back( planes[c] );
+            out_planes.push_back( cv::Mat( pM.iHeight, pM.iWidth, CV_MAKETYPE( cv::DataType<T>::depth, 1 ) ) );
+
+            if( !pM.vPlaneGain.empty() )
+                plane_gains.push_back( pM.vPlaneGain[c] );
+        }
+    }
+
+    resampleSources< T, 1, I, rowSource< T, 1 > >( eqr_planes, pM, plane_gains.empty() ? NULL : plane_gains.data(), out_planes );
+
+    for( size_t k = 0; k < out_imgs.size(); ++k )
+    {
+        const std::vector<cv::Mat> planes( out_planes.begin() + k * C, out_planes.begin() + ( k + 1 ) * C );
+        cv::merge( planes, out_imgs[k] );
+    }
+}
+
+/*********************************************************************
+*  projection map
+*
+**********************************************************************/
+
+/*! \brief Projection map computation, see computeMap */
+void  computeMap( const gnomonicGeometry & gG,
+            const int & iWidth,
+            const int & iHeight,
+            projectionMap & pM )
+{
+    pM.iWidth  = iWidth;
+    pM.iHeight = iHeight;
+    pM.vMapX.resize( (size_t) iWidth * iHeight );
+    pM.vMapY.resize( (size_t) iWidth * iHeight );
+
+    #pragma omp parallel for schedule(static)
+    for( int y = 0; y < iHeight; ++y )
+    {
+        float * pX = &pM.vMapX[ (size_t) y * iWidth ];
+        float * pY = &pM.vMapY[ (size_t) y * iWidth ];
+
+        for( int x = 0; x < iWidth; ++x )
+        {
+            double u, v;
+            sensorToEqr( gG, x, y, u, v );
+            pX[x] = u;
+            pY[x] = v;
+        }
+    }
+}
+
+/*! \brief Single precision projection map computation, see computeMap */
+void  computeMapFast( const gnomonicGeometry & gG,
+            const int & iWidth,
+            const int & iHeight,
+            projectionMap & pM )
+{
+    pM.iWidth  = iWidth;
+    pM.iHeight = iHeight;
+    pM.vMapX.resize( (size_t) iWidth * iHeight );
+    pM.vMapY.resize( (size_t) iWidth * iHeight );
+
+    float m[3][3];
+    for( int i = 0; i < 3; ++i )
+        for( int j = 0; j < 3; ++j )
+            m[i][j] = gG.lfMatrix[i][j];
+
+    const float lfPixelSize = gG.lfPixelSize;
+    const float lfpx0       = gG.lfpx0;
+    const float lfZ         = gG.lfFocalLength;
+    const float lfScaleX    = gG.lfMapWidth  / ( 2.0 * LG_PI );
+    const float lfScaleY    = gG.lfMapHeight / LG_PI;
+    const float lfCornerX   = gG.lfCornerX;
+    const float lfCornerY   = gG.lfCornerY;
+    const float lfMapWidth  = gG.lfMapWidth;
+
+    #pragma omp parallel for schedule(static)
+    for( int y = 0; y < iHeight; ++y )
+    {
+        float * pX = &pM.vMapX[ (size_t) y * iWidth ];
+        float * pY = &pM.vMapY[ (size_t) y * iWidth ];
+
+        const float lfY = ( y - gG.lfpy0 ) * gG.lfPixelSize;
+
+        // row terms of the rotated ray
+        const float lfRowX = m[0][1] * lfY + m[0][2] * lfZ;
+        const float lfRowY = m[1][1] * lfY + m[1][2] * lfZ;
+        const float lfRowZ = m[2][1] * lfY + m[2][2] * lfZ;
+
+        for( int x = 0; x < iWidth; ++x )
+        {
+            const float lfX = ( x - lfpx0 ) * lfPixelSize;
+
+            const float lfXp = m[0][0] * lfX + lfRowX;
+            const float lfYp = m[1][0] * lfX + lfRowY;
+            const float lfZp = m[2][0] * lfX + lfRowZ;
+
+            float lfLongitude = fastAtan2( lfXp, lfZp );
+            lfLongitude = lfLongitude < 0.0f ? lfLongitude + 6.28318531f : lfLongitude;
+
+            const float lfColatitude = 1.57079633f - fastAtan2( - lfYp, std::sqrt( lfXp * lfXp + lfZp * lfZp ) );
+
+            const float u = lfLongitude * lfScaleX - lfCornerX;
+            pX[x] = u < 0.0f ? u + lfMapWidth : u;
+            pY[x] = lfColatitude * lfScaleY - lfCornerY;
+        }
+    }
+}
+
+/*********************************************************************
+*  point reprojection
+*
+**********************************************************************/
+
+/*! \brief Sensor to EQR tile coordinates of points, see selectPointKernel
+*
+* Double precision through libm, the loop is scalar for every instruction set.
+*/
+void  sensorToEqrPoints( const gnomonicGeometry & gG,
+            const double * pPoints,
+            const size_t & iCount,
+            double * pProjected )
+{
+    #pragma omp parallel for schedule(static)
+    for( long i = 0; i < (long) iCount; ++i )
+        sensorToEqr( gG, pPoints[2*i], pPoints[2*i+1], pProjected[2*i], pProjected[2*i+1] );
+}
+
+/*! \brief EQR tile to sensor coordinates of points, see selectPointKernel
+*
+* Double precision through libm, the loop is scalar for every instruction set.
+*/
+void  eqrToSensorPoints( const gnomonicGeometry & gG,
+            const double * pPoints,
+            const size_t & iCount,
+            double * pProjected )
+{
+    #pragma omp parallel for schedule(static)
+    for( long i = 0; i < (long) iCount; ++i )
+    {
+        if( !eqrToSensor( gG, pPoints[2*i], pPoints[2*i+1], pProjected[2*i], pProjected[2*i+1] ) )
+            pProjected[2*i] = pProjected[2*i+1] = NAN;
+    }
+}
+
+/*! \brief Single precision sensor to EQR tile coordinates of points, see selectPointKernel */
+void  sensorToEqrPointsFast( const gnomonicGeometry & gG,
+            const double * pPoints,
+            const size_t & iCount,
+            double * pProjected )
+{
+    float m[3][3];
+    for( int i = 0; i < 3; ++i )
+        for( int j = 0; j < 3; ++j )
+            m[i][j] = gG.lfMatrix[i][j];
+
+    const float lfPixelSize = gG.lfPixelSize;
+    const float lfpx0       = gG.lfpx0;
+    const float lfpy0       = gG.lfpy0;
+    const float lfZ         = gG.lfFocalLength;
+    const float lfScaleX    = gG.lfMapWidth  / ( 2.0 * LG_PI );
+    const float lfScaleY    = gG.lfMapHeight / LG_PI;
+    const float lfCornerX   = gG.lfCornerX;
+    const float lfCornerY   = gG.lfCornerY;
+    const float lfMapWidth  = gG.lfMapWidth;
+
+    #pragma omp parallel for schedule(static)
+    for( long i = 0; i < (long) iCount; ++i )
+    {
+        const float lfX = ( (float) pPoints[2*i]     - lfpx0 ) * lfPixelSize;
+        const float lfY = ( (float) pPoints[2*i + 1] - lfpy0 ) * lfPixelSize;
+
+        const float lfXp = m[0][0] * lfX + m[0][1] * lfY + m[0][2] * lfZ;
+        const float lfYp = m[1][0] * lfX + m[1][1] * lfY + m[1][2] * lfZ;
+        const float lfZp = m[2][0] * lfX + m[2][1] * lfY + m[2][2] * lfZ;
+
+        float lfLongitude = fastAtan2( lfXp, lfZp );
+        lfLongitude = lfLongitude < 0.0f ? lfLongitude + 6.28318531f : lfLongitude;
+
+        const float lfColatitude = 1.57079633f - fastAtan2( - lfYp, std::sqrt( lfXp * lfXp + lfZp * lfZp ) );
+
+        const float u = lfLongitude * lfScaleX - lfCornerX;
+        pProjected[2*i]     = u < 0.0f ? u + lfMapWidth : u;
+        pProjected[2*i + 1] = lfColatitude * lfScaleY - lfCornerY;
+    }
+}
+
+/*! \brief Single precision EQR tile to sensor coordinates of points, see selectPointKernel */
+void  eqrToSensorPointsFast( const gnomonicGeometry & gG,
+            const double * pPoints,
+            const size_t & iCount,
+            double * pProjected )
+{
+    float m[3][3];
+    for( int i = 0; i < 3; ++i )
+        for( int j = 0; j < 3; ++j )
+            m[i][j] = gG.lfMatrix[i][j];
+
+    const float lfpx0       = gG.lfpx0;
+    const float lfpy0       = gG.lfpy0;
+    const float lfScale     = gG.lfFocalLength / gG.lfPixelSize;
+    const float lfScaleX    = 2.0 * LG_PI / gG.lfMapWidth;
+    const float lfScaleY    = LG_PI / gG.lfMapHeight;
+    const float lfCornerX   = gG.lfCornerX;
+    const float lfCornerY   = gG.lfCornerY;
+
+    #pragma omp parallel for schedule(static)
+    for( long i = 0; i < (long) iCount; ++i )
+    {
+        float lfSinLon, lfCosLon, lfSinLat, lfCosLat;
+        fastSinCos( ( (float) pPoints[2*i]     + lfCornerX ) * lfScaleX, lfSinLon, lfCosLon );
+        fastSinCos( ( (float) pPoints[2*i + 1] + lfCornerY ) * lfScaleY, lfSinLat, lfCosLat );
+
+        const float lfXp =   lfSinLat * lfSinLon;
+        const float lfYp = - lfCosLat;
+        const float lfZp =   lfSinLat * lfCosLon;
+
+        const float lfX = m[0][0] * lfXp + m[1][0] * lfYp + m[2][0] * lfZp;
+        const float lfY = m[0][1] * lfXp + m[1][1] * lfYp + m[2][1] * lfZp;
+        const float lfZ = m[0][2] * lfXp + m[1][2] * lfYp + m[2][2] * lfZp;
+
+        // rays behind the sensor are selected out, so that the loop stays vectorized
+        const float lfRatio = lfScale / lfZ;
+        pProjected[2*i]     = lfZ > 0.0f ? lfpx0 + lfX * lfRatio : NAN;
+        pProjected[2*i + 1] = lfZ > 0.0f ? lfpy0 + lfY * lfRatio : NAN;
+    }
+}
+
+/*********************************************************************
+*  kernel table
+*
+**********************************************************************/
+
+#define KERNELS_LAYOUT( T, C, I ) \
+    { resampleFrames< T, C, I, rowSource< T, C >     >, \
+      resampleFrames< T, C, I, blockedSource< T, C > >, \
+      resamplePlanes< T, C, I > }
+
+#define KERNELS_INTERPOLATION( T, C ) \
+    { KERNELS_LAYOUT( T, C, nearestInterpolation  ), \
+      KERNELS_LAYOUT( T, C, bilinearInterpolation ), \
+      KERNELS_LAYOUT( T, C, bicubicInterpolation  ) }
+
+#define KERNELS_PLANES( T ) \
+    { KERNELS_INTERPOLATION( T, 1 ), \
+      KERNELS_INTERPOLATION( T, 3 ), \
+      KERNELS_INTERPOLATION( T, 4 ) }
+
+/*! \brief Kernels indexed by depth, number of planes, interpolation method and layout */
+extern const resampleFunction kernelTable[3][3][3][3];
+const resampleFunction kernelTable[3][3][3][3] = {
+    KERNELS_PLANES( unsigned char  ),
+    KERNELS_PLANES( unsigned short ),
+    KERNELS_PLANES( float          )
+};
+
+}
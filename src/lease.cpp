@@ -0,0 +1,227 @@
+/*
+* gnoproj
+*
+* Copyright (c) 2013-2015 FOXEL SA - http://foxel.ch
+* Please read <http://foxel.ch/license> for more information.
+*
+*
+* Author(s):
+*
+*      Stéphane Flotron <s.flotron@foxel.ch>
+*
+* Contributor(s):
+*
+*      Luc Deschenaux <luc.deschenaux@foxel.ch>
+*
+*
+* This file is part of the FOXEL project <http://foxel.ch>.
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Affero General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Affero General Public License for more details.
+*
+* You should have received a copy of the GNU Affero General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*
+* Additional Terms:
+*
+*      You are required to preserve legal notices and author attributions in
+*      that material or in the Appropriate Legal Notices displayed by works
+*      containing it.
+*
+*      You are required to attribute the work as explained in the "Usage and
+*      Attribution" section of <http://foxel.ch/license>.
+*/
+
+#include "lease.hpp"
+#include <iostream>
+#include <sstream>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+using namespace std;
+
+/*********************************************************************
+*  lease file names
+*
+**********************************************************************/
+
+static std::string  leaseFile( const std::string & sDirectory,
+            const std::string & sKey,
+            const unsigned & iGeneration )
+{
+    std::ostringstream name;
+    name << sDirectory << "/" << sKey << ".lease." << iGeneration;
+    return name.str();
+}
+
+static std::string  doneFile( const std::string & sDirectory,
+            const std::string & sKey )
+{
+    return sDirectory + "/" + sKey + ".done";
+}
+
+/*********************************************************************
+*  lease file queries
+*
+**********************************************************************/
+
+static bool  fileExists( const std::string & sFile )
+{
+    struct stat status;
+    return stat( sFile.c_str(), &status ) == 0;
+}
+
+// last generation of the lease files of a batch, or -1 if there is none
+static long  lastGeneration( const std::string & sDirectory,
+            const std::string & sKey )
+{
+    long iGeneration = -1;
+
+    while( fileExists( leaseFile( sDirectory, sKey, iGeneration + 1 ) ) )
+        ++iGeneration;
+
+    return iGeneration;
+}
+
+/*********************************************************************
+*  worker identifier
+*
+**********************************************************************/
+
+std::string  workerName( )
+{
+    char hostname[256] = { 0 };
+    gethostname( hostname, sizeof( hostname ) - 1 );
+
+    std::ostringstream name;
+    name << hostname << "-" << getpid();
+    return name.str();
+};
+
+/*********************************************************************
+*  claim a batch
+*
+**********************************************************************/
+
+bool  claimLease( const std::string & sDirectory,
+            const std::string & sKey,
+            const double & lfDuration,
+            jobLease & lease )
+{
+    if( fileExists( doneFile( sDirectory, sKey ) ) )
+        return false;
+
+    // check if the current lease, if any, is expired
+    const long iLast = lastGeneration( sDirectory, sKey );
+    if( iLast >= 0 )
+    {
+        struct stat status;
+        if( stat( leaseFile( sDirectory, sKey, iLast ).c_str(), &status ) != 0 )
+            return false;
+
+        if( difftime( time( NULL ), status.st_mtime ) < lfDuration )
+            return false;
+
+        std::cerr << " Lease " << sKey << " expired, reclaiming it" << std::endl;
+    }
+
+    // atomic creation, only one worker can get this generation
+    const unsigned iGeneration = iLast + 1;
+    const std::string sLease = leaseFile( sDirectory, sKey, iGeneration );
+
+    const int fd = open( sLease.c_str(), O_CREAT | O_EXCL | O_WRONLY, 0644 );
+    if( fd < 0 )
+        return false;
+
+    const std::string sOwner = workerName() + "\n";
+    const ssize_t iWritten = write( fd, sOwner.c_str(), sOwner.size() );
+    close( fd );
+
+    if( iWritten != (ssize_t) sOwner.size() )
+    {
+        unlink( sLease.c_str() );
+        return false;
+    }
+
+    lease.sDirectory  = sDirectory;
+    lease.sKey        = sKey;
+    lease.iGeneration = iGeneration;
+    lease.lfDuration  = lfDuration;
+
+    return true;
+};
+
+/*********************************************************************
+*  renew a lease
+*
+**********************************************************************/
+
+bool  renewLease( const jobLease & lease )
+{
+    // lease taken over by another worker
+    if( fileExists( leaseFile( lease.sDirectory, lease.sKey, lease.iGeneration + 1 ) ) )
+        return false;
+
+    return utimes( leaseFile( lease.sDirectory, lease.sKey, lease.iGeneration ).c_str(), NULL ) == 0;
+};
+
+/*********************************************************************
+*  complete a batch
+*
+**********************************************************************/
+
+void  completeLease( const jobLease & lease )
+{
+    const std::string sDone = doneFile( lease.sDirectory, lease.sKey );
+
+    const int fd = open( sDone.c_str(), O_CREAT | O_WRONLY, 0644 );
+    if( fd < 0 )
+    {
+        std::cerr << " Cannot create " << sDone << std::endl;
+        return;
+    }
+    close( fd );
+
+    // remove all generations, the done file is enough from now on
+    for( long i = lastGeneration( lease.sDirectory, lease.sKey ); i >= 0; --i )
+        unlink( leaseFile( lease.sDirectory, lease.sKey, i ).c_str() );
+};
+
+/*********************************************************************
+*  release a lease
+*
+**********************************************************************/
+
+void  releaseLease( const jobLease & lease )
+{
+    // lease taken over by another worker, nothing to release
+    if( fileExists( leaseFile( lease.sDirectory, lease.sKey, lease.iGeneration + 1 ) ) )
+        return;
+
+    // the lease is expired at once, the batch is claimed with the next generation
+    struct timeval times[2] = { { 0, 0 }, { 0, 0 } };
+    if( utimes( leaseFile( lease.sDirectory, lease.sKey, lease.iGeneration ).c_str(), times ) != 0 )
+        std::cerr << " Cannot release lease " << lease.sKey << std::endl;
+};
+
+/*********************************************************************
+*  query a batch
+*
+**********************************************************************/
+
+bool  batchDone( const std::string & sDirectory,
+            const std::string & sKey )
+{
+    return fileExists( doneFile( sDirectory, sKey ) );
+};
@@ -0,0 +1,185 @@
+/*
+* gnoproj
+*
+* Copyright (c) 2013-2015 FOXEL SA - http://foxel.ch
+* Please read <http://foxel.ch/license> for more information.
+*
+*
+* Author(s):
+*
+*      Stéphane Flotron <s.flotron@foxel.ch>
+*
+* Contributor(s):
+*
+*      Luc Deschenaux <luc.deschenaux@foxel.ch>
+*
+*
+* This file is part of the FOXEL project <http://foxel.ch>.
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Affero General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Affero General Public License for more details.
+*
+* You should have received a copy of the GNU Affero General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*
+* Additional Terms:
+*
+*      You are required to preserve legal notices and author attributions in
+*      that material or in the Appropriate Legal Notices displayed by works
+*      containing it.
+*
+*      You are required to attribute the work as explained in the "Usage and
+*      Attribution" section of <http://foxel.ch/license>.
+*/
+
+  /*! \file lease.hpp
+   * \author Stephane Flotron <s.flotron@foxel.ch>
+   */
+
+#ifndef LEASE_HPP_
+#define LEASE_HPP_
+
+#include <string>
+
+/******************************************************************************
+* jobLease
+*****************************************************************************/
+
+/*! \struct jobLease
+* \brief structure used to store a lease on a batch of jobs
+*
+* A lease is a file created with O_EXCL in a directory shared by all the
+* workers. Its modification time is refreshed while the batch is processed.
+* When a lease is older than its duration, the worker that held it is
+* considered dead and the batch can be claimed again, by creating the lease
+* file of the next generation (key.lease.N+1). As O_EXCL creation is atomic,
+* only one worker can take over a stale lease.
+*
+* \var jobLease::sDirectory
+*  Shared directory where lease files are created
+* \var jobLease::sKey
+*  Name of the claimed batch
+* \var jobLease::iGeneration
+*  Generation of the lease held by this worker
+* \var jobLease::lfDuration
+*  Lease duration in seconds
+*/
+
+struct jobLease
+{
+  std::string sDirectory  = "";
+  std::string sKey        = "";
+  unsigned    iGeneration = 0;
+  double      lfDuration  = 0.0;
+};
+
+/*********************************************************************
+*  worker identifier
+*
+**********************************************************************/
+
+/*! \brief Worker identifier
+*
+* \return hostname and pid of the current process, as hostname-pid
+*/
+
+std::string  workerName( ) ;
+
+/*********************************************************************
+*  claim a batch
+*
+**********************************************************************/
+
+/*! \brief Batch claiming
+*
+* This function tries to claim a batch. It fails if the batch is already
+* done, or if another worker holds a lease that is not expired yet. Hosts
+* sharing the claim directory are expected to have synchronized clocks.
+*
+* \param sDirectory   Shared directory where lease files are created
+* \param sKey         Name of the batch
+* \param lfDuration   Lease duration in seconds
+* \param lease        Lease filled if the batch is claimed
+*
+* \return bool value that says if the batch was claimed or not
+*/
+
+bool  claimLease( const std::string & sDirectory,
+            const std::string & sKey,
+            const double & lfDuration,
+            jobLease & lease ) ;
+
+/*********************************************************************
+*  renew a lease
+*
+**********************************************************************/
+
+/*! \brief Lease renewal
+*
+* This function refreshes a lease, and has to be called more often than the
+* lease duration. It fails if the lease was taken over by another worker, in
+* which case the batch must not be processed further.
+*
+* \param lease   The lease to renew
+*
+* \return bool value that says if the lease is still held or not
+*/
+
+bool  renewLease( const jobLease & lease ) ;
+
+/*********************************************************************
+*  complete a batch
+*
+**********************************************************************/
+
+/*! \brief Batch completion
+*
+* This function marks the batch as done, so that no other worker claims it,
+* and removes the lease files.
+*
+* \param lease   The lease of the completed batch
+*/
+
+void  completeLease( const jobLease & lease ) ;
+
+/*********************************************************************
+*  release a lease
+*
+**********************************************************************/
+
+/*! \brief Lease release
+*
+* This function gives up a batch that could not be projected, without
+* marking it as done : the lease is expired at once, so that the batch can be
+* claimed again by any worker.
+*
+* \param lease   The lease of the failed batch
+*/
+
+void  releaseLease( const jobLease & lease ) ;
+
+/*********************************************************************
+*  query a batch
+*
+**********************************************************************/
+
+/*! \brief Batch completion query
+*
+* \param sDirectory   Shared directory where lease files are created
+* \param sKey         Name of the batch
+*
+* \return bool value that says if the batch was marked as done or not
+*/
+
+bool  batchDone( const std::string & sDirectory,
+            const std::string & sKey ) ;
+
+#endif
@@ -0,0 +1,157 @@
+/*
+* gnoproj
+*
+* Copyright (c) 2013-2015 FOXEL SA - http://foxel.ch
+* Please read <http://foxel.ch/license> for more information.
+*
+*
+* Author(s):
+*
+*      Stéphane Flotron <s.flotron@foxel.ch>
+*
+* Contributor(s):
+*
+*      Luc Deschenaux <luc.deschenaux@foxel.ch>
+*
+*
+* This file is part of the FOXEL project <http://foxel.ch>.
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Affero General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Affero General Public License for more details.
+*
+* You should have received a copy of the GNU Affero General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*
+* Additional Terms:
+*
+*      You are required to preserve legal notices and author attributions in
+*      that material or in the Appropriate Legal Notices displayed by works
+*      containing it.
+*
+*      You are required to attribute the work as explained in the "Usage and
+*      Attribution" section of <http://foxel.ch/license>.
+*/
+
+  /*! \file kernels_test.cpp
+   * \author Stephane Flotron <s.flotron@foxel.ch>
+   *
+   * Tests of the projection kernels, run by ctest. The kernels of the
+   * baseline instruction set are compiled here in a namespace of their own,
+   * so that their internal functions can be tested directly.
+   */
+
+#define GNOPROJ_ISA isa_test
+#include "../kernels_impl.hpp"
+#include <iostream>
+
+/*********************************************************************
+*  test helpers
+*
+**********************************************************************/
+
+static int  failures = 0;
+
+static void  check( const bool bCondition, const std::string & sTest )
+{
+    if( !bCondition )
+    {
+        std::cerr << " FAILED : " << sTest << std::endl;
+        ++failures;
+    }
+}
+
+/*********************************************************************
+*  interior tile test
+*
+**********************************************************************/
+
+static void  testInteriorTile( )
+{
+    const int iSide = 16;
+    std::vector<float> vX( iSide * iSide ), vY( iSide * iSide );
+
+    for( int y = 0; y < iSide; ++y )
+        for( int x = 0; x < iSide; ++x )
+        {
+            vX[y * iSide + x] = 20.0f + x * 0.5f;
+            vY[y * iSide + x] = 30.0f + y * 0.5f;
+        }
+
+    check(  isa_test::interiorTile<isa_test::bicubicInterpolation>( &vX[0], &vY[0], iSide, iSide, iSide, 64, 64 ), "interior tile" );
+    check( !isa_test::interiorTile<isa_test::bicubicInterpolation>( &vX[0], &vY[0], iSide, iSide, iSide, 64, 28 ), "tile crossing the border" );
+
+    // NaN in the middle of the tile, where std::min and std::max drop it
+    vX[8 * iSide + 8] = NAN;
+    check( !isa_test::interiorTile<isa_test::bicubicInterpolation>( &vX[0], &vY[0], iSide, iSide, iSide, 64, 64 ), "NaN x in the middle of a tile" );
+    check( !isa_test::interiorTile<isa_test::nearestInterpolation>( &vX[0], &vY[0], iSide, iSide, iSide, 64, 64 ), "NaN x with nearest interpolation" );
+
+    vX[8 * iSide + 8] = 24.0f;
+    vY[5 * iSide + 11] = NAN;
+    check( !isa_test::interiorTile<isa_test::bicubicInterpolation>( &vX[0], &vY[0], iSide, iSide, iSide, 64, 64 ), "NaN y in the middle of a tile" );
+
+    vY[5 * iSide + 11] = 32.5f;
+    vX[0] = NAN;
+    check( !isa_test::interiorTile<isa_test::bicubicInterpolation>( &vX[0], &vY[0], iSide, iSide, iSide, 64, 64 ), "NaN x as first sample of a tile" );
+}
+
+/*********************************************************************
+*  resampling with NaN coordinates
+*
+**********************************************************************/
+
+static void  testNanResampling( )
+{
+    std::vector<cv::Mat> eqr_imgs( 1, cv::Mat( 64, 64, CV_8UC3 ) );
+    for( int y = 0; y < 64; ++y )
+        for( int x = 0; x < 64 * 3; ++x )
+            eqr_imgs[0].ptr<unsigned char>( y )[x] = ( x * 7 + y * 13 ) & 255;
+
+    projectionMap pM;
+    pM.iWidth  = 32;
+    pM.iHeight = 32;
+    pM.iTile   = 16;
+
+    for( int y = 0; y < pM.iHeight; ++y )
+        for( int x = 0; x < pM.iWidth; ++x )
+        {
+            pM.vMapX.push_back( 10.0f + x * 1.3f );
+            pM.vMapY.push_back( 12.0f + y * 1.1f );
+        }
+
+    std::vector<cv::Mat> reference( 1, cv::Mat( pM.iHeight, pM.iWidth, CV_8UC3 ) );
+    isa_test::resampleFrames< unsigned char, 3, isa_test::bicubicInterpolation, isa_test::rowSource< unsigned char, 3 > >( eqr_imgs, pM, reference );
+
+    // the NaN sample is clamped, the other samples of its tile are unchanged
+    const int iNan = 8 * pM.iWidth + 8;
+    pM.vMapX[iNan] = NAN;
+
+    std::vector<cv::Mat> out_imgs( 1, cv::Mat( pM.iHeight, pM.iWidth, CV_8UC3 ) );
+    isa_test::resampleFrames< unsigned char, 3, isa_test::bicubicInterpolation, isa_test::rowSource< unsigned char, 3 > >( eqr_imgs, pM, out_imgs );
+
+    bool bEqual = true;
+    for( int i = 0; i < pM.iWidth * pM.iHeight; ++i )
+        for( int c = 0; c < 3 && i != iNan; ++c )
+            bEqual &= out_imgs[0].ptr<unsigned char>( i / pM.iWidth )[( i % pM.iWidth ) * 3 + c]
+                   == reference[0].ptr<unsigned char>( i / pM.iWidth )[( i % pM.iWidth ) * 3 + c];
+
+    check( bEqual, "samples of a tile with a NaN coordinate" );
+}
+
+int main( )
+{
+    testInteriorTile();
+    testNanResampling();
+
+    if( failures == 0 )
+        std::cout << "kernels_test : all tests passed" << std::endl;
+
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
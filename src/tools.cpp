@@ -41,8 +41,24 @@
 */
 
 #include "tools.hpp"
+#include "lease.hpp"
+#include "geometry.hpp"
+#include "kernels.hpp"
+#include "views.hpp"
 #include "../lib/stlplus3/filesystemSimplified/file_system.hpp"
+#include <chrono>
 #include <cstring>
+#include <fstream>
+#include <map>
+#include <sstream>
+#ifdef GNOPROJ_JPEG
+#include <csetjmp>
+#include <cstdio>
+#include <jpeglib.h>
+#endif
+#ifdef GNOPROJ_TIFF
+#include <tiffio.h>
+#endif
 
 using namespace std;
 using namespace cv;
@@ -54,7 +70,7 @@ using namespace cv;
 *********************************************************************
 */
 
-static bool split ( const std::string src, const std::string& delim, std::vector<std::string>& vec_value )
+bool split ( const std::string src, const std::string& delim, std::vector<std::string>& vec_value )
 {
   bool bDelimiterExist = false;
   if ( !delim.empty() )
@@ -155,17 +171,15 @@ bool  loadCalibrationData( sensorData & sD,
 };
 
 /*********************************************************************
-*  Project EQR image using libgnomonic
+*  Build output image name from EQR image name
 *
 **********************************************************************/
 
-bool  eqrToGnomonic (
+std::string  outputImageName (
             const std::string & input_image,
             const std::string & output_directory,
-            const std::string & mount_point,
-            const std::string & mac_address,
             const int & normalizedFocal,
-            const double & focal )
+            const std::string & sSuffix )
 {
     std::string output_image_filename=output_directory+"/"; // output image filename
 
@@ -175,112 +189,2059 @@ bool  eqrToGnomonic (
 
     const std::string image_basename =  split_slash[split_slash.size()-1];
 
-    // extract channel information from image name
-    std::vector<string>  splitted_name;
+    // extract output name information from image name
     std::vector<string>  out_split;
-
-    split( image_basename, "-", splitted_name );
     split( image_basename, "_", out_split );
 
-    // check if output image already exists
     if(!normalizedFocal)
     {
-        output_image_filename+=out_split[0]+"_"+out_split[1]+"-RECT-SENSOR.tiff";
+        output_image_filename+=out_split[0]+"_"+out_split[1]+"-RECT-SENSOR"+sSuffix;
     }
     else
     {
       // create output image name
-      output_image_filename+=out_split[0]+out_split[1]+"-RECT-CONFOC.tiff";
+      output_image_filename+=out_split[0]+out_split[1]+"-RECT-CONFOC"+sSuffix;
+    }
+
+    return output_image_filename;
+};
+
+/*********************************************************************
+*  Output image extension
+*
+**********************************************************************/
+
+std::string  outputImageExtension( const projectionOptions & options )
+{
+#ifdef GNOPROJ_JPEG
+    // 4:2:0 planes are handed to the JPEG encoder as raw data
+    if( options.iColorspace == COLORSPACE_YCBCR420 )
+        return ".jpg";
+#else
+    (void) options;
+#endif
+
+    return ".tiff";
+};
+
+/*********************************************************************
+*  Output image suffix
+*
+**********************************************************************/
+
+std::string  outputImageSuffix( const projectionOptions & options )
+{
+    std::ostringstream suffix;
+
+    if( options.iRoiWidth > 0 )
+        suffix << "-ROI" << options.iRoiX << "_" << options.iRoiY << "_" << options.iRoiWidth << "x" << options.iRoiHeight;
+
+    suffix << outputImageExtension( options );
+
+    return suffix.str();
+};
+
+/*********************************************************************
+*  Parse a region of interest
+*
+**********************************************************************/
+
+bool  parseRoi( const std::string & sRoi,
+            projectionOptions & options )
+{
+    std::vector<string>  fields;
+
+    if( !split( sRoi, ",", fields ) || fields.size() != 4 )
+        return false;
+
+    long lValues[4];
+
+    for( int i = 0; i < 4; ++i )
+    {
+        char * pEnd = NULL;
+        lValues[i] = strtol( fields[i].c_str(), &pEnd, 10 );
+
+        if( fields[i].empty() || *pEnd != '\0' || lValues[i] < 0 )
+            return false;
     }
 
-    if ( stlplus::file_exists( output_image_filename ) )
+    if( lValues[2] < 1 || lValues[3] < 1 )
+        return false;
+
+    options.iRoiX      = lValues[0];
+    options.iRoiY      = lValues[1];
+    options.iRoiWidth  = lValues[2];
+    options.iRoiHeight = lValues[3];
+
+    return true;
+};
+
+/*********************************************************************
+*  load per-frame attitudes
+*
+**********************************************************************/
+
+bool  loadAttitudes( const std::string & sFilename,
+            std::map<std::string, frameAttitude> & attitudes )
+{
+    std::ifstream file( sFilename.c_str() );
+
+    if( !file.is_open() )
     {
-      std::cerr << "\nThe output image exists, do nothing" << std::endl;
-      return false;
+        std::cerr << " Cannot open attitude file " << sFilename << std::endl;
+        return false;
     }
 
-    const size_t sensor_index=atoi(splitted_name[1].c_str());
-    sensorData   sensorSD;
+    attitudes.clear();
 
-    // load calibration informations
-    bool  bLoadCalibration = loadCalibrationData
-                                  ( sensorSD,
-                                    sensor_index,
-                                    mount_point,
-                                    mac_address );
+    std::string sLine;
+    size_t iLine = 0;
 
-    if( !bLoadCalibration )
+    while( std::getline( file, sLine ) )
     {
-      std::cerr << " Failed to load calibration informations. Exit " << std::endl;
-      return false;
+        ++iLine;
+
+        if( sLine.empty() || sLine[0] == '#' || sLine == "\r" )
+            continue;
+
+        std::vector<string>  fields;
+        split( sLine, ",", fields );
+
+        double lfAngles[3];
+        bool bValid = fields.size() == 4 && !fields[0].empty();
+
+        for( int i = 0; bValid && i < 3; ++i )
+        {
+            char * pEnd = NULL;
+            lfAngles[i] = strtod( fields[i + 1].c_str(), &pEnd );
+            bValid = pEnd != fields[i + 1].c_str() && ( *pEnd == '\0' || *pEnd == '\r' );
+        }
+
+        if( !bValid )
+        {
+            std::cerr << " Invalid attitude at line " << iLine << " of " << sFilename << std::endl;
+            return false;
+        }
+
+        frameAttitude fA;
+        fA.lfRoll  = lfAngles[0] * LG_PI / 180.0;
+        fA.lfPitch = lfAngles[1] * LG_PI / 180.0;
+        fA.lfYaw   = lfAngles[2] * LG_PI / 180.0;
+
+        attitudes[fields[0]] = fA;
+    }
+
+    return true;
+};
+
+/*********************************************************************
+*  load calibration data through a cache
+*
+**********************************************************************/
+
+bool  cachedCalibrationData( sensorData & sD,
+            const size_t      & sensor_index,
+            const std::string & sMountPoint,
+            const std::string & smacAddress)
+{
+    static std::map<std::string, sensorData> calibrationCache;
+
+    std::ostringstream key;
+    key << sMountPoint << "/" << smacAddress << "/" << sensor_index;
+
+    bool bLoaded = true;
+
+    // libfastcal is not reentrant, the cache is filled by one thread at a time
+    #pragma omp critical(calibrationCache)
+    {
+        std::map<std::string, sensorData>::const_iterator it = calibrationCache.find( key.str() );
+
+        if( it != calibrationCache.end() )
+            sD = it->second;
+        else if( ( bLoaded = loadCalibrationData( sD, sensor_index, sMountPoint, smacAddress ) ) )
+            calibrationCache[key.str()] = sD;
+    }
+
+    return bLoaded;
+};
+
+/*********************************************************************
+*  Load EQR image at its native depth
+*
+**********************************************************************/
+
+static cv::Rect  clampRegion( const cv::Rect & region,
+            const int & iWidth,
+            const int & iHeight )
+{
+    // at least one pixel, the kernels clamp the samples outside of the tile
+    const int iX0 = std::min( std::max( region.x, 0 ), iWidth  - 1 );
+    const int iY0 = std::min( std::max( region.y, 0 ), iHeight - 1 );
+    const int iX1 = std::min( std::max( region.x + region.width,  iX0 + 1 ), iWidth  );
+    const int iY1 = std::min( std::max( region.y + region.height, iY0 + 1 ), iHeight );
+
+    return cv::Rect( iX0, iY0, iX1 - iX0, iY1 - iY0 );
+};
+
+#ifdef GNOPROJ_TIFF
+// sums of the samples of a row over the blocks of the reduced row, the last
+// block being completed by the last column as libjpeg does
+template <typename T>
+static void  sumTiffRow( const unsigned char * pRow,
+            const int & iFirst,
+            const int & iWidth,
+            const int & iScale,
+            const int & iSamples,
+            std::vector<float> & vSums )
+{
+    const T * pSamples = (const T *) pRow;
+    const int iCols = vSums.size() / iSamples;
+
+    for( int c = 0; c < iCols; ++c )
+        for( int i = 0; i < iScale; ++i )
+        {
+            const T * pPixel = pSamples + ( iFirst + std::min( c * iScale + i, iWidth - 1 ) ) * iSamples;
+
+            for( int p = 0; p < iSamples; ++p )
+                vSums[c * iSamples + p] += pPixel[p];
+        }
+};
+
+template <typename T>
+static void  averageTiffRow( const std::vector<float> & vSums,
+            const float & lfNorm,
+            unsigned char * pOut )
+{
+    for( size_t i = 0; i < vSums.size(); ++i )
+        ( (T *) pOut )[i] = cv::saturate_cast<T>( vSums[i] * lfNorm );
+};
+
+static bool  readTiffStrips( const std::string & input_image,
+            const projectionOptions & options,
+            cv::Rect * pRegion,
+            cv::Mat & eqr_img )
+{
+    TIFF * tiff = TIFFOpen( input_image.c_str(), "r" );
+
+    if( !tiff )
+        return false;
+
+    uint32_t iWidth = 0, iHeight = 0, iRowsPerStrip = 0;
+    uint16_t iSamples = 1, iBits = 8, iFormat = SAMPLEFORMAT_UINT, iConfig = PLANARCONFIG_CONTIG, iPhotometric = PHOTOMETRIC_MINISBLACK;
+
+    TIFFGetField( tiff, TIFFTAG_IMAGEWIDTH, &iWidth );
+    TIFFGetField( tiff, TIFFTAG_IMAGELENGTH, &iHeight );
+    TIFFGetFieldDefaulted( tiff, TIFFTAG_ROWSPERSTRIP, &iRowsPerStrip );
+    TIFFGetFieldDefaulted( tiff, TIFFTAG_SAMPLESPERPIXEL, &iSamples );
+    TIFFGetFieldDefaulted( tiff, TIFFTAG_BITSPERSAMPLE, &iBits );
+    TIFFGetFieldDefaulted( tiff, TIFFTAG_SAMPLEFORMAT, &iFormat );
+    TIFFGetFieldDefaulted( tiff, TIFFTAG_PLANARCONFIG, &iConfig );
+    TIFFGetField( tiff, TIFFTAG_PHOTOMETRIC, &iPhotometric );
+
+    // strips of interleaved 8, 16 bits or float samples, other layouts go through the decoder
+    int iDepth = -1;
+    if( iFormat == SAMPLEFORMAT_UINT && iBits == 8 )
+        iDepth = CV_8U;
+    else if( iFormat == SAMPLEFORMAT_UINT && iBits == 16 )
+        iDepth = CV_16U;
+    else if( iFormat == SAMPLEFORMAT_IEEEFP && iBits == 32 )
+        iDepth = CV_32F;
+
+    const bool bGray = iSamples == 1 && iPhotometric == PHOTOMETRIC_MINISBLACK;
+    const bool bRgb  = ( iSamples == 3 || iSamples == 4 ) && iPhotometric == PHOTOMETRIC_RGB;
+
+    if( TIFFIsTiled( tiff ) || iConfig != PLANARCONFIG_CONTIG || iDepth < 0 || !( bGray || bRgb ) || !iWidth || !iHeight )
+    {
+        TIFFClose( tiff );
+        return false;
+    }
+
+    /* Rows of the region, or averages of the blocks of the reduced image, so
+       that reduced pixel r is centered on r*s+(s-1)/2 as assumed by
+       scaleGeometry ; strips outside of the region are not decoded */
+    const cv::Rect region = pRegion ? clampRegion( *pRegion, iWidth, iHeight ) : cv::Rect( 0, 0, iWidth, iHeight );
+
+    if( pRegion )
+        *pRegion = region;
+
+    const int iScale = options.iPreview;
+    const int iCols  = ( region.width  + iScale - 1 ) / iScale;
+    const int iRows  = ( region.height + iScale - 1 ) / iScale;
+
+    const size_t iPixelBytes = (size_t) iSamples * iBits / 8;
+    const size_t iRowBytes   = (size_t) iWidth * iPixelBytes;
+
+    cv::Mat reduced( iRows, iCols, CV_MAKETYPE( iDepth, iSamples ) );
+    std::vector<unsigned char> vStrip( TIFFStripSize( tiff ) );
+    std::vector<float> vSums( (size_t) iCols * iSamples );
+    const float lfNorm = 1.0f / ( iScale * iScale );
+    tstrip_t iLoaded = (tstrip_t) -1;
+
+    for( int r = 0; r < iRows; ++r )
+    {
+        std::fill( vSums.begin(), vSums.end(), 0.0f );
+
+        for( int j = 0; j < iScale; ++j )
+        {
+            const uint32_t iRow = region.y + std::min( r * iScale + j, region.height - 1 );
+            const tstrip_t iStrip = TIFFComputeStrip( tiff, iRow, 0 );
+
+            if( iStrip != iLoaded )
+            {
+                if( TIFFReadEncodedStrip( tiff, iStrip, vStrip.data(), (tsize_t) -1 ) < 0 )
+                {
+                    TIFFClose( tiff );
+                    return false;
+                }
+
+                iLoaded = iStrip;
+            }
+
+            const unsigned char * pRow = vStrip.data() + ( iRow % iRowsPerStrip ) * iRowBytes;
+
+            if( iScale == 1 )
+            {
+                memcpy( reduced.ptr( r ), pRow + region.x * iPixelBytes, iCols * iPixelBytes );
+                continue;
+            }
+
+            switch( iDepth )
+            {
+                case CV_8U  : sumTiffRow<unsigned char> ( pRow, region.x, region.width, iScale, iSamples, vSums ); break;
+                case CV_16U : sumTiffRow<unsigned short>( pRow, region.x, region.width, iScale, iSamples, vSums ); break;
+                case CV_32F : sumTiffRow<float>         ( pRow, region.x, region.width, iScale, iSamples, vSums ); break;
+            }
+        }
+
+        if( iScale == 1 )
+            continue;
+
+        switch( iDepth )
+        {
+            case CV_8U  : averageTiffRow<unsigned char> ( vSums, lfNorm, reduced.ptr( r ) ); break;
+            case CV_16U : averageTiffRow<unsigned short>( vSums, lfNorm, reduced.ptr( r ) ); break;
+            case CV_32F : averageTiffRow<float>         ( vSums, lfNorm, reduced.ptr( r ) ); break;
+        }
     }
+
+    TIFFClose( tiff );
+
+    // planes as cv::imread would give them, RGB being stored by TIFF
+    if( bRgb )
+        cv::cvtColor( reduced, reduced, iSamples == 3 ? cv::COLOR_RGB2BGR : cv::COLOR_RGBA2BGR );
+
+    if( options.iPlanes == PLANES_LUMINANCE && bRgb )
+        cv::cvtColor( reduced, eqr_img, cv::COLOR_BGR2GRAY );
+    else if( options.iPlanes == PLANES_COLOR && bGray )
+        cv::cvtColor( reduced, eqr_img, cv::COLOR_GRAY2BGR );
     else
+        eqr_img = reduced;
+
+    return true;
+};
+#endif
+
+static bool  readEqrImage( const std::string & input_image,
+            const projectionOptions & options,
+            cv::Mat & eqr_img,
+            cv::Rect * pRegion = NULL )
+{
+    // the decoder converts BGR to luminance if needed
+    int iReadFlags = cv::IMREAD_ANYDEPTH | cv::IMREAD_COLOR;
+    if( options.iPlanes == PLANES_LUMINANCE )
+        iReadFlags = cv::IMREAD_ANYDEPTH | cv::IMREAD_GRAYSCALE;
+    else if( options.iPlanes == PLANES_RAW )
+        iReadFlags = cv::IMREAD_UNCHANGED;
+
+    // previews are decoded at reduced size, by the scaled DCT of libjpeg
+    // for JPEG images, by sampling the strips of TIFF images
+    if( options.iPreview == 2 )
+        iReadFlags |= cv::IMREAD_REDUCED_GRAYSCALE_2;
+    else if( options.iPreview == 4 )
+        iReadFlags |= cv::IMREAD_REDUCED_GRAYSCALE_4;
+    else if( options.iPreview == 8 )
+        iReadFlags |= cv::IMREAD_REDUCED_GRAYSCALE_8;
+
+    bool bDecoded = false;
+
+#ifdef GNOPROJ_TIFF
+    const std::string sExtension = stlplus::extension_part( input_image );
+
+    if( ( options.iPreview > 1 || pRegion ) && ( sExtension == "tif" || sExtension == "tiff" ) )
+        bDecoded = readTiffStrips( input_image, options, pRegion, eqr_img );
+#endif
+
+    if( !bDecoded )
+        eqr_img = cv::imread( input_image, iReadFlags );
+
+    if( eqr_img.empty() )
+    {
+        std::cerr << " Cannot load " << input_image << std::endl;
+        return false;
+    }
+
+    // other decoders give the whole image, the region is a view of it
+    if( pRegion && !bDecoded )
+    {
+        *pRegion = clampRegion( *pRegion, eqr_img.cols, eqr_img.rows );
+        eqr_img  = eqr_img( *pRegion );
+    }
+
+    // integer depths other than 8 and 16 bits are processed as float
+    if( eqr_img.depth() != CV_8U && eqr_img.depth() != CV_16U && eqr_img.depth() != CV_32F )
+        eqr_img.convertTo( eqr_img, CV_MAKETYPE( CV_32F, eqr_img.channels() ) );
+
+    return true;
+};
+
+/*********************************************************************
+*  Export gnomonic image
+*
+**********************************************************************/
+
+#ifdef GNOPROJ_JPEG
+/* libjpeg errors exit the process by default, they jump back to the encoder
+   instead so that only the image fails */
+struct jpegErrorManager
+{
+  jpeg_error_mgr jerr;
+  jmp_buf        jump;
+};
+
+static void  jpegErrorExit( j_common_ptr cinfo )
+{
+    ( *cinfo->err->output_message )( cinfo );
+    longjmp( ( (jpegErrorManager *) cinfo->err )->jump, 1 );
+};
+
+static bool  writeJpeg420( const cv::Mat & out_img,
+            const std::string & output_image_filename,
+            const int & iQuality )
+{
+    // luma plane followed by the Cb and Cr planes side by side
+    const int iWidth  = out_img.cols;
+    const int iHeight = out_img.rows * 2 / 3;
+
+    /* The encoder reads whole blocks: rows are padded to a multiple of 16
+       luma samples, by copy unless the planes are already aligned. The
+       buffer is allocated before the error jump point, which it outlives */
+    const int  iPadded  = ( iWidth + 15 ) & ~15;
+    const bool bAligned = iPadded == iWidth;
+    std::vector<JSAMPLE> vStrip( bAligned ? 0 : 32 * iPadded );
+
+    FILE * file = fopen( output_image_filename.c_str(), "wb" );
+
+    if( !file )
+        return false;
+
+    jpeg_compress_struct cinfo;
+    jpegErrorManager     jerr;
+
+    cinfo.err = jpeg_std_error( &jerr.jerr );
+    jerr.jerr.error_exit = jpegErrorExit;
+
+    if( setjmp( jerr.jump ) )
+    {
+        jpeg_destroy_compress( &cinfo );
+        fclose( file );
+        unlink( output_image_filename.c_str() );
+        return false;
+    }
+
+    jpeg_create_compress( &cinfo );
+    jpeg_stdio_dest( &cinfo, file );
+
+    cinfo.image_width      = iWidth;
+    cinfo.image_height     = iHeight;
+    cinfo.input_components = 3;
+    cinfo.in_color_space   = JCS_YCbCr;
+
+    jpeg_set_defaults( &cinfo );
+    jpeg_set_colorspace( &cinfo, JCS_YCbCr );
+    jpeg_set_quality( &cinfo, iQuality, TRUE );
+
+    // the planes are already subsampled, the encoder only runs the DCT
+    cinfo.raw_data_in = TRUE;
+    cinfo.comp_info[0].h_samp_factor = 2;
+    cinfo.comp_info[0].v_samp_factor = 2;
+    for( int c = 1; c < 3; ++c )
+    {
+        cinfo.comp_info[c].h_samp_factor = 1;
+        cinfo.comp_info[c].v_samp_factor = 1;
+    }
+
+    jpeg_start_compress( &cinfo, TRUE );
+
+    JSAMPROW    pY[16], pCb[8], pCr[8];
+    JSAMPARRAY  pPlanes[3] = { pY, pCb, pCr };
+
+    while( cinfo.next_scanline < cinfo.image_height )
     {
-        // load image
-        IplImage* eqr_img = cvLoadImage(input_image.c_str(), CV_LOAD_IMAGE_COLOR );
-
-        /* Initialize output image structure */
-        IplImage* out_img = cvCreateImage( cvSize( sensorSD.lfWidth, sensorSD.lfHeight ), IPL_DEPTH_8U , eqr_img->nChannels );
-
-        if(!normalizedFocal){
-              /* Gnomonic projection of the equirectangular tile */
-              lg_ttg_elphel(
-                  ( inter_C8_t *) eqr_img->imageData,
-                  eqr_img->width,
-                  eqr_img->height,
-                  eqr_img->nChannels,
-                  ( inter_C8_t *) out_img->imageData,
-                  out_img->width,
-                  out_img->height,
-                  out_img->nChannels,
-                  sensorSD.lfpx0,
-                  sensorSD.lfpy0,
-                  sensorSD.lfImageFullWidth,
-                  sensorSD.lfImageFullHeight-1, // there's an extra pixel for wrapping
-                  sensorSD.lfXPosition,
-                  sensorSD.lfYPosition,
-                  sensorSD.lfRoll,
-                  sensorSD.lfAzimuth,
-                  sensorSD.lfElevation,
-                  sensorSD.lfHeading,
-                  sensorSD.lfPixelSize,
-                  sensorSD.lfFocalLength,
-                  li_bicubicf
-              );
+        const int iRow = cinfo.next_scanline;
+
+        for( int r = 0; r < 16; ++r )
+        {
+            JSAMPLE * pRow = const_cast<JSAMPLE *>( out_img.ptr<JSAMPLE>( std::min( iRow + r, iHeight - 1 ) ) );
+            pY[r] = bAligned ? pRow : &vStrip[r * iPadded];
+
+            if( !bAligned )
+            {
+                memcpy( pY[r], pRow, iWidth );
+                memset( pY[r] + iWidth, pY[r][iWidth - 1], iPadded - iWidth );
+            }
         }
-        else
+
+        for( int r = 0; r < 8; ++r )
         {
-              /* Gnomonic projection of the equirectangular tile */
-              lg_ttg_center(
-              ( inter_C8_t *) eqr_img->imageData,
-              eqr_img->width,
-              eqr_img->height,
-              eqr_img->nChannels,
-              ( inter_C8_t *) out_img->imageData,
-              out_img->width,
-              out_img->height,
-              out_img->nChannels,
+            JSAMPLE * pRow = const_cast<JSAMPLE *>( out_img.ptr<JSAMPLE>( iHeight + std::min( iRow / 2 + r, iHeight / 2 - 1 ) ) );
+            pCb[r] = bAligned ? pRow : &vStrip[( 16 + r ) * iPadded];
+            pCr[r] = bAligned ? pRow + iWidth / 2 : pCb[r] + iPadded / 2;
+
+            if( !bAligned )
+            {
+                memcpy( pCb[r], pRow, iWidth / 2 );
+                memset( pCb[r] + iWidth / 2, pCb[r][iWidth / 2 - 1], ( iPadded - iWidth ) / 2 );
+                memcpy( pCr[r], pRow + iWidth / 2, iWidth / 2 );
+                memset( pCr[r] + iWidth / 2, pCr[r][iWidth / 2 - 1], ( iPadded - iWidth ) / 2 );
+            }
+        }
+
+        jpeg_write_raw_data( &cinfo, pPlanes, 16 );
+    }
+
+    jpeg_finish_compress( &cinfo );
+    jpeg_destroy_compress( &cinfo );
+
+    if( fclose( file ) != 0 )
+    {
+        unlink( output_image_filename.c_str() );
+        return false;
+    }
+
+    return true;
+};
+#endif
+
+static bool  writeGnomonicImage( const cv::Mat & out_img,
+            const std::string & output_image_filename,
+            const projectionOptions & options )
+{
+    /* Gnomonic image exportation, renamed once complete so that a crashed
+       worker never leaves a partial image looking like a projected one */
+    const std::string sExtension = outputImageExtension( options );
+    const std::string partial_image_filename = output_image_filename + "." + workerName() + ".partial" + sExtension;
+
+#ifdef GNOPROJ_JPEG
+    if( sExtension == ".jpg" && out_img.depth() != CV_8U )
+    {
+        std::cerr << " JPEG sensor images need 8 bits samples, " << output_image_filename << " not written" << std::endl;
+        return false;
+    }
+
+    const bool bSaved = sExtension == ".jpg" ? writeJpeg420( out_img, partial_image_filename, options.iQuality )
+                                             : cv::imwrite( partial_image_filename, out_img );
+#else
+    const bool bSaved = cv::imwrite( partial_image_filename, out_img );
+#endif
+
+    if( !bSaved )
+    {
+        unlink( partial_image_filename.c_str() );
+        return false;
+    }
+
+    if( rename( partial_image_filename.c_str(), output_image_filename.c_str() ) != 0 )
+    {
+        std::cerr << " Cannot rename " << partial_image_filename << std::endl;
+        unlink( partial_image_filename.c_str() );
+        return false;
+    }
+
+    return true;
+};
+
+/*********************************************************************
+*  Export gnomonic image and its reduced levels
+*
+**********************************************************************/
+
+static std::string  levelImageName( const std::string & output_image_filename,
+            const int & iLevel )
+{
+    const size_t iDot = output_image_filename.rfind( '.' );
+
+    std::ostringstream level_image;
+    level_image << output_image_filename.substr( 0, iDot ) << "-L" << iLevel << output_image_filename.substr( iDot );
+
+    return level_image.str();
+};
+
+static bool  writeSensorImages( const std::vector<cv::Mat> & out_imgs,
+            const size_t & k,
+            const size_t & iFrames,
+            const std::string & output_image_filename,
+            const projectionOptions & options )
+{
+    // levels are written first, the sensor image marks the frame as projected
+    for( int l = options.iLevels; l > 0; --l )
+    {
+        if( !writeGnomonicImage( out_imgs[ l * iFrames + k ], levelImageName( output_image_filename, l ), options ) )
+            return false;
+    }
+
+    return writeGnomonicImage( out_imgs[k], output_image_filename, options );
+};
+
+/*********************************************************************
+*  Project EQR image using libgnomonic
+*
+**********************************************************************/
+
+static void  gnomonicLibrary( const cv::Mat & eqr_img,
+            const sensorData & sensorSD,
+            const int & normalizedFocal,
+            const double & focal,
+            cv::Mat & out_img )
+{
+    if(!normalizedFocal){
+          /* Gnomonic projection of the equirectangular tile */
+          lg_ttg_elphel(
+              ( inter_C8_t *) eqr_img.data,
+              eqr_img.cols,
+              eqr_img.rows,
+              eqr_img.channels(),
+              ( inter_C8_t *) out_img.data,
+              out_img.cols,
+              out_img.rows,
+              out_img.channels(),
+              sensorSD.lfpx0,
+              sensorSD.lfpy0,
               sensorSD.lfImageFullWidth,
-              sensorSD.lfImageFullHeight-1,
+              sensorSD.lfImageFullHeight-1, // there's an extra pixel for wrapping
               sensorSD.lfXPosition,
               sensorSD.lfYPosition,
-              sensorSD.lfAzimuth + sensorSD.lfHeading + LG_PI,
-              sensorSD.lfElevation,
               sensorSD.lfRoll,
-              focal,
+              sensorSD.lfAzimuth,
+              sensorSD.lfElevation,
+              sensorSD.lfHeading,
               sensorSD.lfPixelSize,
+              sensorSD.lfFocalLength,
               li_bicubicf
-              );
-          }
-
-        /* Gnomonic image exportation */
-        cvSaveImage(output_image_filename.c_str() , out_img, NULL );
+          );
+    }
+    else
+    {
+          /* Gnomonic projection of the equirectangular tile */
+          lg_ttg_center(
+          ( inter_C8_t *) eqr_img.data,
+          eqr_img.cols,
+          eqr_img.rows,
+          eqr_img.channels(),
+          ( inter_C8_t *) out_img.data,
+          out_img.cols,
+          out_img.rows,
+          out_img.channels(),
+          sensorSD.lfImageFullWidth,
+          sensorSD.lfImageFullHeight-1,
+          sensorSD.lfXPosition,
+          sensorSD.lfYPosition,
+          sensorSD.lfAzimuth + sensorSD.lfHeading + LG_PI,
+          sensorSD.lfElevation,
+          sensorSD.lfRoll,
+          focal,
+          sensorSD.lfPixelSize,
+          li_bicubicf
+          );
+    }
+};
+
+/*********************************************************************
+*  Project EQR images using OpenCV
+*
+**********************************************************************/
+
+static void  remapFrames( const std::vector<cv::Mat> & eqr_imgs,
+            const projectionMap & mapSD,
+            const int & iInterpolation,
+            std::vector<cv::Mat> & out_imgs )
+{
+    static const int remapInterpolation[] = { cv::INTER_NEAREST, cv::INTER_LINEAR, cv::INTER_CUBIC };
+
+    // fixed point maps, integer positions and interpolation table indices
+    const cv::Mat mapX( mapSD.iHeight, mapSD.iWidth, CV_32FC1, (void *) mapSD.vMapX.data() );
+    const cv::Mat mapY( mapSD.iHeight, mapSD.iWidth, CV_32FC1, (void *) mapSD.vMapY.data() );
+
+    cv::Mat map1, map2;
+    cv::convertMaps( mapX, mapY, map1, map2, CV_16SC2, iInterpolation == INTERPOLATION_NEAREST );
+
+    // cv::remap is parallel internally, frames are remapped one after the other
+    for( size_t k = 0; k < eqr_imgs.size(); ++k )
+        cv::remap( eqr_imgs[k], out_imgs[k], map1, map2, remapInterpolation[iInterpolation], cv::BORDER_REPLICATE );
+};
+
+/*********************************************************************
+*  Stage timing
+*
+**********************************************************************/
+
+static double  stageTime( std::chrono::steady_clock::time_point & tStage )
+{
+    const std::chrono::steady_clock::time_point tNow = std::chrono::steady_clock::now();
+    const double lfSeconds = std::chrono::duration<double>( tNow - tStage ).count();
+
+    tStage = tNow;
+    return lfSeconds;
+};
+
+/*********************************************************************
+*  Projection map of a geometry
+*
+**********************************************************************/
+
+static bool  geometryMap( const gnomonicGeometry & geometrySD,
+            const int & iWidth,
+            const int & iHeight,
+            const projectionOptions & options,
+            projectionMap & mapSD )
+{
+    /* Sparse map when its deviation stays below the threshold, dense map otherwise */
+    if( options.lfGridThreshold <= 0.0
+     || computeSparseMap( geometrySD, iWidth, iHeight, options.lfGridThreshold, mapSD ) > options.lfGridThreshold )
+    {
+        mapSD = projectionMap();
+        computeMap( geometrySD, iWidth, iHeight, mapSD, options.bFastMath );
+    }
+
+    if( options.bCheckMap )
+    {
+        const double lfTolerance = std::max( 0.01, options.lfGridThreshold );
+        const double lfDeviation = mapDeviation( geometrySD, mapSD, 1 );
+        std::cerr << " Map deviation " << lfDeviation << " pixel, grid step " << mapSD.iStep << std::endl;
+
+        if( lfDeviation > lfTolerance )
+        {
+            std::cerr << " Map deviation above " << lfTolerance << " pixel" << std::endl;
+            return false;
+        }
+    }
+
+    return true;
+};
+
+/*********************************************************************
+*  Warp of sensor images through a cache
+*
+**********************************************************************/
+
+/* sensor coordinates of each pixel of the warped image */
+struct sensorWarp
+{
+  cv::Mat mapX;
+  cv::Mat mapY;
+};
+
+static bool  loadWarp( const std::string & sWarp,
+            const size_t & sensor_index,
+            const sensorData & sensorSD,
+            sensorWarp & warp )
+{
+    try
+    {
+        cv::FileStorage fs( sWarp, cv::FileStorage::READ );
+
+        if( !fs.isOpened() )
+        {
+            std::cerr << " Cannot read warp " << sWarp << std::endl;
+            return false;
+        }
+
+        // warp of the channel, or warp shared by all channels
+        std::ostringstream channel;
+        channel << "channel" << sensor_index;
+
+        cv::FileNode node = fs[channel.str()];
+        if( node.empty() )
+            node = fs.root();
+
+        if( !node["mapX"].empty() )
+        {
+            node["mapX"] >> warp.mapX;
+            node["mapY"] >> warp.mapY;
+        }
+        else
+        {
+            cv::Mat cameraMatrix, distortion, rectification, projection;
+
+            node["camera_matrix"]           >> cameraMatrix;
+            node["distortion_coefficients"] >> distortion;
+            node["rectification_matrix"]    >> rectification;
+            node["projection_matrix"]       >> projection;
+
+            if( cameraMatrix.empty() )
+            {
+                std::cerr << " No mapX nor camera_matrix for channel " << sensor_index << " in " << sWarp << std::endl;
+                return false;
+            }
+
+            const cv::Size size(
+                node["image_width"].empty()  ? (int) sensorSD.lfWidth  : (int) node["image_width"],
+                node["image_height"].empty() ? (int) sensorSD.lfHeight : (int) node["image_height"] );
+
+            cv::initUndistortRectifyMap( cameraMatrix, distortion, rectification,
+                projection.empty() ? cameraMatrix : projection, size, CV_32FC1, warp.mapX, warp.mapY );
+        }
+    }
+    catch( const cv::Exception & e )
+    {
+        std::cerr << " Cannot read warp " << sWarp << " : " << e.what() << std::endl;
+        return false;
+    }
+
+    if( warp.mapX.empty() || warp.mapX.size() != warp.mapY.size() || warp.mapX.channels() != 1 || warp.mapY.channels() != 1 )
+    {
+        std::cerr << " Invalid warp maps for channel " << sensor_index << " in " << sWarp << std::endl;
+        return false;
+    }
+
+    // continuous single precision maps
+    warp.mapX.convertTo( warp.mapX, CV_32F );
+    warp.mapY.convertTo( warp.mapY, CV_32F );
+    warp.mapX = warp.mapX.clone();
+    warp.mapY = warp.mapY.clone();
+
+    return true;
+};
+
+static const sensorWarp *  cachedWarp( const std::string & sWarp,
+            const size_t & sensor_index,
+            const sensorData & sensorSD )
+{
+    static std::map<std::string, sensorWarp> warpCache;
+
+    std::ostringstream key;
+    key << sWarp << "/" << sensor_index;
+
+    const sensorWarp * pWarp = NULL;
+
+    #pragma omp critical(warpCache)
+    {
+        std::map<std::string, sensorWarp>::const_iterator it = warpCache.find( key.str() );
+
+        sensorWarp warp;
+
+        if( it != warpCache.end() )
+            pWarp = &it->second;
+        else if( loadWarp( sWarp, sensor_index, sensorSD, warp ) )
+            pWarp = &( warpCache[key.str()] = warp );
+    }
+
+    return pWarp;
+};
+
+/*********************************************************************
+*  Photometric correction of sensor images through a cache
+*
+**********************************************************************/
+
+/* gain of each pixel and of each plane, empty if not corrected */
+struct sensorPhotometry
+{
+  std::vector<float> vGain;
+  std::vector<float> vPlaneGain;
+};
+
+// the correction is given in full resolution output pixels, and evaluated in
+// the images reduced by iScale, pixel x being centered on x*s+(s-1)/2 as in
+// scaleGeometry
+static bool  loadPhotometry( const std::string & sPhotometry,
+            const size_t & sensor_index,
+            const int & iWidth,
+            const int & iHeight,
+            const int & iScale,
+            sensorPhotometry & photometry )
+{
+    const int iOutWidth  = iWidth  / iScale;
+    const int iOutHeight = iHeight / iScale;
+
+    double lfGain = 1.0;
+    cv::Mat gainMap;
+    std::vector<double> vignetting;
+    double lfCenterX = iWidth / 2.0, lfCenterY = iHeight / 2.0;
+
+    try
+    {
+        cv::FileStorage fs( sPhotometry, cv::FileStorage::READ );
+
+        if( !fs.isOpened() )
+        {
+            std::cerr << " Cannot read photometric correction " << sPhotometry << std::endl;
+            return false;
+        }
+
+        // correction of the channel, or correction shared by all channels
+        std::ostringstream channel;
+        channel << "channel" << sensor_index;
+
+        cv::FileNode node = fs[channel.str()];
+        if( node.empty() )
+            node = fs.root();
+
+        if( !node["gain"].empty() )
+            lfGain = (double) node["gain"];
+
+        node["gain_map"] >> gainMap;
+
+        const cv::FileNode vignettingNode = node["vignetting"];
+        for( size_t i = 0; i < vignettingNode.size(); ++i )
+            vignetting.push_back( (double) vignettingNode[(int) i] );
+
+        const cv::FileNode centerNode = node["vignetting_center"];
+        if( centerNode.size() == 2 )
+        {
+            lfCenterX = (double) centerNode[0];
+            lfCenterY = (double) centerNode[1];
+        }
+
+        const cv::FileNode balanceNode = node["white_balance"];
+        for( size_t i = 0; i < balanceNode.size(); ++i )
+            photometry.vPlaneGain.push_back( (double) balanceNode[(int) i] );
+    }
+    catch( const cv::Exception & e )
+    {
+        std::cerr << " Cannot read photometric correction " << sPhotometry << " : " << e.what() << std::endl;
+        return false;
+    }
+
+    if( !gainMap.empty() )
+    {
+        if( gainMap.channels() != 1 )
+        {
+            std::cerr << " Gain map of channel " << sensor_index << " has more than one plane" << std::endl;
+            return false;
+        }
+
+        // flat fields may be stored at a lower resolution
+        gainMap.convertTo( gainMap, CV_32F );
+        if( gainMap.size() != cv::Size( iOutWidth, iOutHeight ) )
+            cv::resize( gainMap, gainMap, cv::Size( iOutWidth, iOutHeight ), 0, 0, cv::INTER_LINEAR );
+    }
+
+    if( gainMap.empty() && vignetting.empty() && lfGain == 1.0 )
+        return true;
+
+    /* Gain of each pixel, the vignetting polynomial being evaluated in the
+       square of the distance to its center, relative to the half diagonal */
+    const double lfRadius2 = ( (double) iWidth * iWidth + (double) iHeight * iHeight ) / 4.0;
+    const double lfOffset  = ( iScale - 1.0 ) / 2.0;
+
+    photometry.vGain.resize( (size_t) iOutWidth * iOutHeight );
 
-        /* Free memory */
-        cvReleaseImage(&eqr_img);
-        cvReleaseImage(&out_img);
+    #pragma omp parallel for schedule(static)
+    for( int y = 0; y < iOutHeight; ++y )
+    {
+        const double lfY = y * iScale + lfOffset - lfCenterY;
+
+        for( int x = 0; x < iOutWidth; ++x )
+        {
+            const double lfX = x * iScale + lfOffset - lfCenterX;
+            const double r2  = ( lfX * lfX + lfY * lfY ) / lfRadius2;
+
+            double lfVignetting = 0.0;
+            for( size_t i = vignetting.size(); i > 0; --i )
+                lfVignetting = ( lfVignetting + vignetting[i - 1] ) * r2;
+
+            const double lfFlat = gainMap.empty() ? 1.0 : gainMap.ptr<float>( y )[x];
+
+            photometry.vGain[ (size_t) y * iOutWidth + x ] = lfGain * lfFlat * ( 1.0 + lfVignetting );
+        }
+    }
+
+    return true;
+};
+
+static const sensorPhotometry *  cachedPhotometry( const std::string & sPhotometry,
+            const size_t & sensor_index,
+            const int & iWidth,
+            const int & iHeight,
+            const int & iScale )
+{
+    static std::map<std::string, sensorPhotometry> photometryCache;
+
+    std::ostringstream key;
+    key << sPhotometry << "/" << sensor_index << "/" << iWidth << "x" << iHeight << "/" << iScale;
+
+    const sensorPhotometry * pPhotometry = NULL;
+
+    #pragma omp critical(photometryCache)
+    {
+        std::map<std::string, sensorPhotometry>::const_iterator it = photometryCache.find( key.str() );
+
+        sensorPhotometry photometry;
+
+        if( it != photometryCache.end() )
+            pPhotometry = &it->second;
+        else if( loadPhotometry( sPhotometry, sensor_index, iWidth, iHeight, iScale, photometry ) )
+            pPhotometry = &( photometryCache[key.str()] = photometry );
+    }
+
+    return pPhotometry;
+};
+
+/*********************************************************************
+*  Reduced levels after cv::remap or libgnomonic
+*
+**********************************************************************/
+
+static void  reduceFrames( std::vector<cv::Mat> & out_imgs,
+            const size_t & iFrames )
+{
+    // box filtered, each level from the previous one
+    for( size_t i = iFrames; i < out_imgs.size(); ++i )
+        cv::resize( out_imgs[ i - iFrames ], out_imgs[i], out_imgs[i].size(), 0, 0, cv::INTER_AREA );
+};
+
+/*********************************************************************
+*  Photometric correction after cv::remap
+*
+**********************************************************************/
+
+static void  correctFrames( const sensorPhotometry & photometry,
+            const size_t & iFrames,
+            std::vector<cv::Mat> & out_imgs )
+{
+    for( size_t k = 0; k < iFrames; ++k )
+    {
+        cv::Mat values;
+        out_imgs[k].convertTo( values, CV_32F );
+
+        const int C = values.channels();
+
+        #pragma omp parallel for schedule(static)
+        for( int y = 0; y < values.rows; ++y )
+        {
+            float * pValues = values.ptr<float>( y );
+
+            for( int x = 0; x < values.cols; ++x )
+            {
+                const float lfGain = photometry.vGain.empty() ? 1.0f : photometry.vGain[ (size_t) y * values.cols + x ];
+
+                for( int c = 0; c < C; ++c )
+                    pValues[ x * C + c ] *= lfGain * ( photometry.vPlaneGain.empty() ? 1.0f : photometry.vPlaneGain[c] );
+            }
+        }
+
+        values.convertTo( out_imgs[k], out_imgs[k].type() );
+    }
+};
+
+/*********************************************************************
+*  Projection map of a sensor
+*
+**********************************************************************/
+
+static void  sensorGeometry( const sensorData & sensorSD,
+            const int & normalizedFocal,
+            const double & focal,
+            const frameAttitude * pAttitude,
+            const projectionOptions & options,
+            gnomonicGeometry & geometrySD )
+{
+    if(!normalizedFocal)
+        elphelGeometry( sensorSD, geometrySD );
+    else
+        centerGeometry( sensorSD, focal, geometrySD );
+
+    if( pAttitude )
+        attitudeGeometry( *pAttitude, geometrySD );
+
+    // a region of interest is projected as a sensor image of its own
+    if( options.iRoiWidth > 0 )
+    {
+        geometrySD.lfpx0 -= options.iRoiX;
+        geometrySD.lfpy0 -= options.iRoiY;
+    }
+
+    // previews are projected between the reduced EQR and sensor images
+    if( options.iPreview > 1 )
+        scaleGeometry( options.iPreview, geometrySD );
+};
+
+static void  sensorSize( const sensorData & sensorSD,
+            const projectionOptions & options,
+            int & iWidth,
+            int & iHeight )
+{
+    iWidth  = options.iRoiWidth  > 0 ? options.iRoiWidth  : (int) sensorSD.lfWidth  / options.iPreview;
+    iHeight = options.iRoiHeight > 0 ? options.iRoiHeight : (int) sensorSD.lfHeight / options.iPreview;
+};
+
+static bool  sensorMap( const sensorData & sensorSD,
+            const int & normalizedFocal,
+            const double & focal,
+            const frameAttitude * pAttitude,
+            const sensorWarp * pWarp,
+            const projectionOptions & options,
+            projectionMap & mapSD )
+{
+    gnomonicGeometry  geometrySD;
+    sensorGeometry( sensorSD, normalizedFocal, focal, pAttitude, options, geometrySD );
+
+    // composed maps are exact, neither sparse nor checked
+    if( pWarp )
+    {
+        composeMap( geometrySD, pWarp->mapX.cols, pWarp->mapX.rows, pWarp->mapX.ptr<float>(), pWarp->mapY.ptr<float>(), mapSD );
+        return true;
+    }
+
+    int iWidth, iHeight;
+    sensorSize( sensorSD, options, iWidth, iHeight );
+
+    return geometryMap( geometrySD, iWidth, iHeight, options, mapSD );
+};
+
+/*********************************************************************
+*  Region of the EQR tile sampled by a region of interest
+*
+**********************************************************************/
+
+static cv::Rect  eqrRegion( const sensorData & sensorSD,
+            const int & normalizedFocal,
+            const double & focal,
+            const frameAttitude * pAttitude,
+            const projectionOptions & options )
+{
+    gnomonicGeometry  geometrySD;
+    sensorGeometry( sensorSD, normalizedFocal, focal, pAttitude, options, geometrySD );
+
+    double lfUMin, lfUMax, lfVMin, lfVMax;
+    eqrFootprint( geometrySD, options.iRoiWidth, options.iRoiHeight, lfUMin, lfUMax, lfVMin, lfVMax );
 
+    // margin for the bicubic footprint, the deviation of sparse maps and the
+    // samples between the grid of the footprint
+    const int iMargin = 4;
+
+    const int iX = (int) floor( lfUMin ) - iMargin;
+    const int iY = (int) floor( lfVMin ) - iMargin;
+
+    return cv::Rect( iX, iY, (int) floor( lfUMax ) + iMargin - iX + 1, (int) floor( lfVMax ) + iMargin - iY + 1 );
+};
+
+/*********************************************************************
+*  Projection of a channel by libgnomonic
+*
+**********************************************************************/
+
+// by default, libgnomonic projects the tiles it supports, so that the
+// output of plain projections does not depend on the kernels, unless an
+// option of the projection map or of the kernels is given
+static bool  gnomonicEngine( const cv::Mat & eqr_img,
+            const frameAttitude * pAttitude,
+            const sensorWarp * pWarp,
+            const projectionOptions & options )
+{
+    if( options.iEngine == ENGINE_GNOMONIC )
         return true;
+
+    return options.iEngine == ENGINE_AUTO
+        && eqr_img.type() == CV_8UC3
+        && options.iInterpolation == INTERPOLATION_BICUBIC
+        && options.iColorspace == COLORSPACE_BGR
+        && options.iPreview == 1
+        && options.iRoiWidth == 0
+        && options.sPhotometry.empty()
+        && !options.bFastMath
+        && !options.bCheckMap
+        && options.lfGridThreshold == 0.0
+        && options.iLayout == LAYOUT_AUTO
+        && !pAttitude
+        && !pWarp;
+};
+
+/*********************************************************************
+*  Project loaded EQR images of a channel
+*
+**********************************************************************/
+
+static bool  projectFrames( const std::vector<cv::Mat> & eqr_imgs,
+            const sensorData & sensorSD,
+            const size_t & sensor_index,
+            const int & normalizedFocal,
+            const double & focal,
+            const frameAttitude * pAttitude,
+            const projectionOptions & options,
+            std::vector<cv::Mat> & out_imgs,
+            std::chrono::steady_clock::time_point & tStage,
+            double & lfMapTime,
+            double & lfResampleTime )
+{
+    /* Warp composed with the projection, if any */
+    const sensorWarp * pWarp = NULL;
+
+    if( !options.sWarp.empty() && !( pWarp = cachedWarp( options.sWarp, sensor_index, sensorSD ) ) )
+        return false;
+
+    /* Initialize output image structures, with the size of the warp */
+    int iOutWidth, iOutHeight;
+    sensorSize( sensorSD, options, iOutWidth, iOutHeight );
+
+    if( pWarp )
+    {
+        iOutWidth  = pWarp->mapX.cols;
+        iOutHeight = pWarp->mapX.rows;
+    }
+
+    if( options.iRoiWidth > 0 && ( options.iRoiX + options.iRoiWidth > (int) sensorSD.lfWidth || options.iRoiY + options.iRoiHeight > (int) sensorSD.lfHeight ) )
+    {
+        std::cerr << " Region of interest exceeds the " << sensorSD.lfWidth << "x" << sensorSD.lfHeight << " sensor of channel " << sensor_index << std::endl;
+        return false;
+    }
+
+    // the photometric correction covers the whole sensor images
+    if( options.iRoiWidth > 0 && !options.sPhotometry.empty() )
+    {
+        std::cerr << " Photometric correction is not available with a region of interest" << std::endl;
+        return false;
+    }
+
+    /* Colorspace converted by the kernels, 4:2:0 planes stacked in one image */
+    int iOutPlanes = eqr_imgs[0].channels();
+
+    if( options.iColorspace != COLORSPACE_BGR )
+    {
+        if( iOutPlanes < 3 )
+        {
+            std::cerr << " Colorspace conversion needs BGR images, channel " << sensor_index << " has " << iOutPlanes << " planes" << std::endl;
+            return false;
+        }
+
+        iOutPlanes = options.iColorspace == COLORSPACE_GRAY ? 1 : 3;
+
+        if( options.iColorspace == COLORSPACE_YCBCR420 )
+        {
+            // 4:2:0 planes are written as 8 bits JPEG, checked before the projection runs
+            if( eqr_imgs[0].depth() != CV_8U )
+            {
+                std::cerr << " 4:2:0 sensor images need 8 bits samples, channel " << sensor_index << " has "
+                          << eqr_imgs[0].elemSize1() << " bytes samples" << std::endl;
+                return false;
+            }
+
+            // chroma planes of every level are subsampled by two
+            const int iMultiple = 2 << options.iLevels;
+
+            if( iOutWidth % iMultiple || iOutHeight % iMultiple )
+            {
+                std::cerr << " 4:2:0 sensor images need a size multiple of " << iMultiple << ", channel " << sensor_index << " is "
+                          << iOutWidth << "x" << iOutHeight << std::endl;
+                return false;
+            }
+
+            iOutPlanes = 1;
+        }
     }
 
+    /* Reduced levels follow the sensor images of all frames, level by level */
+    const size_t iFrames = eqr_imgs.size();
+
+    out_imgs.resize( iFrames * ( options.iLevels + 1 ) );
+    for( int l = 0; l <= options.iLevels; ++l )
+    {
+        const int iLevelWidth  = iOutWidth >> l;
+        const int iLevelHeight = iOutHeight >> l;
+        const int iLevelRows   = options.iColorspace == COLORSPACE_YCBCR420 ? iLevelHeight + iLevelHeight / 2 : iLevelHeight;
+
+        for( size_t k = 0; k < iFrames; ++k )
+            out_imgs[ l * iFrames + k ].create( iLevelRows, iLevelWidth, CV_MAKETYPE( eqr_imgs[0].depth(), iOutPlanes ) );
+    }
+
+    // libgnomonic only projects 8 bits BGR tiles
+    if( options.iEngine == ENGINE_GNOMONIC && eqr_imgs[0].type() != CV_8UC3 )
+    {
+        std::cerr << " The gnomonic engine needs 8 bits BGR images, channel " << sensor_index << " has "
+                  << eqr_imgs[0].channels() << " planes of " << eqr_imgs[0].elemSize1() << " bytes" << std::endl;
+        return false;
+    }
+
+    /* Photometric correction, given at full resolution and evaluated in the
+       geometry of the output images, reduced levels being reduced from them */
+    const sensorPhotometry * pPhotometry = NULL;
+
+    if( !options.sPhotometry.empty() )
+    {
+        const int iFullWidth  = pWarp ? iOutWidth  : (int) sensorSD.lfWidth;
+        const int iFullHeight = pWarp ? iOutHeight : (int) sensorSD.lfHeight;
+
+        if( !( pPhotometry = cachedPhotometry( options.sPhotometry, sensor_index, iFullWidth, iFullHeight, options.iPreview ) ) )
+            return false;
+
+        if( !pPhotometry->vPlaneGain.empty() && (int) pPhotometry->vPlaneGain.size() != eqr_imgs[0].channels() )
+        {
+            std::cerr << " White balance of channel " << sensor_index << " has " << pPhotometry->vPlaneGain.size()
+                      << " gains for " << eqr_imgs[0].channels() << " planes" << std::endl;
+            return false;
+        }
+    }
+
+    if( gnomonicEngine( eqr_imgs[0], pAttitude, pWarp, options ) )
+    {
+        for( size_t k = 0; k < eqr_imgs.size(); ++k )
+            gnomonicLibrary( eqr_imgs[k], sensorSD, normalizedFocal, focal, out_imgs[k] );
+
+        reduceFrames( out_imgs, iFrames );
+
+        lfResampleTime = stageTime( tStage );
+    }
+    else if( options.iEngine == ENGINE_OPENCV )
+    {
+        /* Dense map, converted to fixed point for cv::remap */
+        projectionOptions denseOptions = options;
+        denseOptions.lfGridThreshold = 0.0;
+
+        projectionMap mapSD;
+
+        if( !sensorMap( sensorSD, normalizedFocal, focal, pAttitude, pWarp, denseOptions, mapSD ) )
+        {
+            std::cerr << " Inaccurate projection map for channel " << sensor_index << std::endl;
+            return false;
+        }
+
+        lfMapTime = stageTime( tStage );
+
+        remapFrames( eqr_imgs, mapSD, options.iInterpolation, out_imgs );
+
+        // cv::remap has no gain, the correction takes another pass
+        if( pPhotometry )
+            correctFrames( *pPhotometry, iFrames, out_imgs );
+
+        reduceFrames( out_imgs, iFrames );
+
+        lfResampleTime = stageTime( tStage );
+    }
+    else
+    {
+        /* Gnomonic projection of the equirectangular tiles, at native depth */
+        if( !selectKernel( eqr_imgs[0].depth(), eqr_imgs[0].channels(), options.iInterpolation ) )
+        {
+            std::cerr << " Unsupported number of planes " << eqr_imgs[0].channels() << " of channel " << sensor_index << std::endl;
+            return false;
+        }
+
+        /* One projection map for all frames of the channel */
+        projectionMap mapSD;
+
+        if( !sensorMap( sensorSD, normalizedFocal, focal, pAttitude, pWarp, options, mapSD ) )
+        {
+            std::cerr << " Inaccurate projection map for channel " << sensor_index << std::endl;
+            return false;
+        }
+
+        /* Tiles sized and oriented for the locality of the EQR tile accesses */
+        planTraversal( mapSD, eqr_imgs[0].elemSize(), eqr_imgs.size() );
+
+        if( options.iLayout != LAYOUT_AUTO )
+            mapSD.iLayout = options.iLayout;
+
+        // gains are applied by the kernels before the samples are stored
+        if( pPhotometry )
+        {
+            mapSD.vGain      = pPhotometry->vGain;
+            mapSD.vPlaneGain = pPhotometry->vPlaneGain;
+        }
+
+        // and converted to the output colorspace, levels being reduced from the stored tiles
+        mapSD.iColorspace = options.iColorspace;
+        mapSD.iLevels     = options.iLevels;
+
+        lfMapTime = stageTime( tStage );
+
+        const resampleFunction resample = selectKernel( eqr_imgs[0].depth(), eqr_imgs[0].channels(), options.iInterpolation, mapSD.iLayout );
+        resample( eqr_imgs, mapSD, out_imgs );
+
+        lfResampleTime = stageTime( tStage );
+    }
+
+    return true;
+};
+
+/*********************************************************************
+*  Project EQR images of a channel
+*
+**********************************************************************/
+
+bool  eqrToGnomonicFrames (
+            const std::vector<std::string> & input_images,
+            const std::string & output_directory,
+            const std::string & mount_point,
+            const std::string & mac_address,
+            const int & normalizedFocal,
+            const double & focal,
+            const projectionOptions & options )
+{
+    bool bProjected = true;
+
+    // frames to project, with their output image name
+    std::vector<std::string> frames;
+    std::vector<std::string> output_images;
+    std::vector<std::string> timestamps;
+    size_t sensor_index = 0;
+
+    for( size_t k = 0; k < input_images.size(); ++k )
+    {
+        const std::string output_image_filename = outputImageName( input_images[k], output_directory, normalizedFocal, outputImageSuffix( options ) );
+
+        // check if output image already exists
+        if ( stlplus::file_exists( output_image_filename ) )
+        {
+          std::cerr << "\nThe output image exists, do nothing" << std::endl;
+          bProjected = false;
+          continue;
+        }
+
+        //extract image basename
+        std::vector<string>  split_slash;
+        split( input_images[k], "/", split_slash );
+
+        const std::string image_basename =  split_slash[split_slash.size()-1];
+
+        // extract channel information from image name
+        std::vector<string>  splitted_name;
+        split( image_basename, "-", splitted_name );
+
+        const size_t frame_index = atoi(splitted_name[1].c_str());
+
+        if( !frames.empty() && frame_index != sensor_index )
+        {
+          std::cerr << " Channel " << frame_index << " of " << input_images[k] << " differs from channel " << sensor_index << std::endl;
+          bProjected = false;
+          continue;
+        }
+
+        sensor_index = frame_index;
+        frames.push_back( input_images[k] );
+        output_images.push_back( output_image_filename );
+        timestamps.push_back( splitted_name[0] );
+    }
+
+    if( frames.empty() )
+      return bProjected;
+
+    sensorData   sensorSD;
+
+    // load calibration informations
+    bool  bLoadCalibration = cachedCalibrationData
+                                  ( sensorSD,
+                                    sensor_index,
+                                    mount_point,
+                                    mac_address );
+
+    if( !bLoadCalibration )
+    {
+      std::cerr << " Failed to load calibration informations. Exit " << std::endl;
+      return false;
+    }
+
+    // stage timing, in seconds
+    std::chrono::steady_clock::time_point tStage = std::chrono::steady_clock::now();
+    double lfReadTime = 0.0, lfMapTime = 0.0, lfResampleTime = 0.0;
+
+    // load all frames, they have to share the type and size of the first one,
+    // except frames projected one by one with their own attitude
+    std::vector<cv::Mat> eqr_imgs;
+    std::vector<std::string> outputs;
+    std::vector<std::string> stamps;
+    std::vector<sensorData> regions;
+
+    for( size_t k = 0; k < frames.size(); ++k )
+    {
+        cv::Mat eqr_img;
+
+        // only the region of the EQR tile sampled by the region of interest is decoded
+        sensorData regionSD = sensorSD;
+        cv::Rect   region;
+
+        if( options.iRoiWidth > 0 )
+        {
+            const frameAttitude * pAttitude = NULL;
+
+            if( options.pAttitudes )
+            {
+                std::map<std::string, frameAttitude>::const_iterator it = options.pAttitudes->find( timestamps[k] );
+
+                if( it == options.pAttitudes->end() )
+                {
+                    std::cerr << " No attitude for frame " << timestamps[k] << std::endl;
+                    bProjected = false;
+                    continue;
+                }
+
+                pAttitude = &it->second;
+            }
+
+            region = eqrRegion( sensorSD, normalizedFocal, focal, pAttitude, options );
+        }
+
+        if( !readEqrImage( frames[k], options, eqr_img, options.iRoiWidth > 0 ? &region : NULL ) )
+        {
+            bProjected = false;
+            continue;
+        }
+
+        if( !eqr_imgs.empty() && ( eqr_img.type() != eqr_imgs[0].type() || ( !options.pAttitudes && eqr_img.size() != eqr_imgs[0].size() ) ) )
+        {
+            std::cerr << " Type or size of " << frames[k] << " differs from the other frames" << std::endl;
+            bProjected = false;
+            continue;
+        }
+
+        // the decoded region is the EQR tile of the projection
+        regionSD.lfXPosition += region.x;
+        regionSD.lfYPosition += region.y;
+
+        eqr_imgs.push_back( eqr_img );
+        outputs.push_back( output_images[k] );
+        stamps.push_back( timestamps[k] );
+        regions.push_back( regionSD );
+    }
+
+    if( eqr_imgs.empty() )
+      return false;
+
+    lfReadTime = stageTime( tStage );
+
+    std::vector<cv::Mat> out_imgs;
+
+    if( !options.pAttitudes )
+    {
+        if( !projectFrames( eqr_imgs, regions[0], sensor_index, normalizedFocal, focal, NULL, options, out_imgs, tStage, lfMapTime, lfResampleTime ) )
+            return false;
+    }
+    else
+    {
+        /* Each frame has its own attitude, hence its own projection map */
+        out_imgs.resize( eqr_imgs.size() * ( options.iLevels + 1 ) );
+
+        for( size_t k = 0; k < eqr_imgs.size(); ++k )
+        {
+            std::map<std::string, frameAttitude>::const_iterator it = options.pAttitudes->find( stamps[k] );
+
+            if( it == options.pAttitudes->end() )
+            {
+                std::cerr << " No attitude for frame " << stamps[k] << std::endl;
+                bProjected = false;
+                continue;
+            }
+
+            std::vector<cv::Mat> frame_out;
+            double lfFrameMapTime = 0.0, lfFrameResampleTime = 0.0;
+
+            if( !projectFrames( std::vector<cv::Mat>( 1, eqr_imgs[k] ), regions[k], sensor_index, normalizedFocal, focal, &it->second, options, frame_out, tStage, lfFrameMapTime, lfFrameResampleTime ) )
+                return false;
+
+            for( int l = 0; l <= options.iLevels; ++l )
+                out_imgs[ l * eqr_imgs.size() + k ] = frame_out[l];
+            lfMapTime      += lfFrameMapTime;
+            lfResampleTime += lfFrameResampleTime;
+        }
+    }
+
+    for( size_t k = 0; k < eqr_imgs.size(); ++k )
+    {
+        if( !out_imgs[k].empty() )
+            bProjected &= writeSensorImages( out_imgs, k, eqr_imgs.size(), outputs[k], options );
+    }
+
+    if( options.bTiming )
+    {
+        std::cerr << " Channel " << sensor_index << ", " << eqr_imgs.size() << " frame(s) :"
+                  << " read "     << lfReadTime     << " s,"
+                  << " map "      << lfMapTime      << " s,"
+                  << " resample " << lfResampleTime << " s,"
+                  << " write "    << stageTime( tStage ) << " s" << std::endl;
+    }
+
+    return bProjected;
+};
+
+/*********************************************************************
+*  Project channels of a full panorama
+*
+**********************************************************************/
+
+bool  eqrPanoramaToGnomonic (
+            const std::string & input_panorama,
+            const std::vector<size_t> & channels,
+            const std::string & output_directory,
+            const std::string & mount_point,
+            const std::string & mac_address,
+            const int & normalizedFocal,
+            const double & focal,
+            const projectionOptions & options )
+{
+    // the number of channels is given by the calibration of the first one
+    sensorData firstSD;
+
+    if( !cachedCalibrationData( firstSD, 0, mount_point, mac_address ) )
+    {
+      std::cerr << " Failed to load calibration informations. Exit " << std::endl;
+      return false;
+    }
+
+    std::vector<size_t> selected( channels );
+    if( selected.empty() )
+    {
+        for( size_t c = 0; c < (size_t) firstSD.lfChannels; ++c )
+            selected.push_back( c );
+    }
+
+    // channel images of the frame are named after the panorama timestamp
+    std::vector<string>  splitted_name;
+    split( stlplus::filename_part( input_panorama ), "-", splitted_name );
+
+    std::vector<size_t> pending;
+    std::vector<std::string> output_images;
+
+    for( size_t k = 0; k < selected.size(); ++k )
+    {
+        if( selected[k] >= (size_t) firstSD.lfChannels )
+        {
+            std::cerr << " Channel " << selected[k] << " out of range, skipped" << std::endl;
+            continue;
+        }
+
+        std::ostringstream channel_image;
+        channel_image << splitted_name[0] << "-" << selected[k] << "-EQR.tiff";
+
+        const std::string output_image_filename = outputImageName( channel_image.str(), output_directory, normalizedFocal, outputImageSuffix( options ) );
+
+        // channels already projected are skipped, so that an interrupted frame can be resumed
+        if( stlplus::file_exists( output_image_filename ) )
+            continue;
+
+        pending.push_back( selected[k] );
+        output_images.push_back( output_image_filename );
+    }
+
+    if( pending.empty() )
+      return true;
+
+    // stage timing, in seconds
+    std::chrono::steady_clock::time_point tStage = std::chrono::steady_clock::now();
+
+    /* Panorama is decoded once for all channels */
+    std::vector<cv::Mat> eqr_imgs( 1 );
+
+    if( !readEqrImage( input_panorama, options, eqr_imgs[0] ) )
+      return false;
+
+    // reduced panoramas are rounded up or down by the decoders
+    const int iScale = options.iPreview;
+
+    if( std::abs( eqr_imgs[0].cols * iScale - (int) firstSD.lfImageFullWidth ) >= iScale || eqr_imgs[0].rows * iScale < (int) firstSD.lfImageFullHeight - iScale )
+    {
+      std::cerr << " Size of " << input_panorama << " differs from the panorama size "
+                << firstSD.lfImageFullWidth << "x" << firstSD.lfImageFullHeight << " reduced by " << iScale << std::endl;
+      return false;
+    }
+
+    // attitude of the frame, shared by all channels
+    const frameAttitude * pAttitude = NULL;
+
+    if( options.pAttitudes )
+    {
+        std::map<std::string, frameAttitude>::const_iterator it = options.pAttitudes->find( splitted_name[0] );
+
+        if( it == options.pAttitudes->end() )
+        {
+            std::cerr << " No attitude for frame " << splitted_name[0] << std::endl;
+            return false;
+        }
+
+        pAttitude = &it->second;
+    }
+
+    const double lfReadTime = stageTime( tStage );
+
+    if( options.bTiming )
+      std::cerr << " Panorama " << input_panorama << " : read " << lfReadTime << " s" << std::endl;
+
+    // blocked and planar copies would be made of the whole panorama for each
+    // channel, rows are read in place
+    projectionOptions panoramaOptions = options;
+    if( panoramaOptions.iLayout == LAYOUT_AUTO )
+        panoramaOptions.iLayout = LAYOUT_ROWS;
+
+    bool bProjected = true;
+
+    /* Channels are projected in parallel, the kernels of each channel run on one thread */
+    #pragma omp parallel for schedule(dynamic) reduction(&&:bProjected)
+    for( int k = 0; k < (int) pending.size(); ++k )
+    {
+        sensorData sensorSD;
+
+        if( !cachedCalibrationData( sensorSD, pending[k], mount_point, mac_address ) )
+        {
+            std::cerr << " Failed to load calibration of channel " << pending[k] << std::endl;
+            bProjected = false;
+            continue;
+        }
+
+        // the panorama itself is the EQR tile
+        sensorSD.lfXPosition = 0.0;
+        sensorSD.lfYPosition = 0.0;
+
+        std::chrono::steady_clock::time_point tChannel = std::chrono::steady_clock::now();
+        double lfMapTime = 0.0, lfResampleTime = 0.0;
+        std::vector<cv::Mat> out_imgs;
+
+        if( !projectFrames( eqr_imgs, sensorSD, pending[k], normalizedFocal, focal, pAttitude, panoramaOptions, out_imgs, tChannel, lfMapTime, lfResampleTime ) )
+        {
+            bProjected = false;
+            continue;
+        }
+
+        bProjected = writeSensorImages( out_imgs, 0, 1, output_images[k], options ) && bProjected;
+
+        if( options.bTiming )
+        {
+            #pragma omp critical(timingReport)
+            std::cerr << " Channel " << pending[k] << " :"
+                      << " map "      << lfMapTime      << " s,"
+                      << " resample " << lfResampleTime << " s,"
+                      << " write "    << stageTime( tChannel ) << " s" << std::endl;
+        }
+    }
+
+    return bProjected;
+};
+
+/*********************************************************************
+*  Projection map of a virtual view through a cache
+*
+**********************************************************************/
+
+static const projectionMap *  cachedViewMap( const virtualView & vV,
+            const int & iPanoramaWidth,
+            const int & iPixelBytes,
+            const projectionOptions & options )
+{
+    static std::map<std::string, projectionMap> viewMapCache;
+
+    std::ostringstream key;
+    key << std::setprecision( 17 ) << vV.lfAzimuth << "/" << vV.lfElevation << "/" << vV.lfRoll << "/" << vV.lfFov
+        << "/" << vV.iWidth << "x" << vV.iHeight << "/" << iPanoramaWidth << "/" << iPixelBytes << "/" << options.iEngine;
+
+    const projectionMap * pMap = NULL;
+
+    #pragma omp critical(viewMapCache)
+    {
+        std::map<std::string, projectionMap>::const_iterator it = viewMapCache.find( key.str() );
+
+        if( it != viewMapCache.end() )
+            pMap = &it->second;
+    }
+
+    if( pMap )
+        return pMap;
+
+    /* Map computed outside of the critical section, the first one inserted is kept */
+    gnomonicGeometry geometryVV;
+    viewGeometry( vV, iPanoramaWidth, geometryVV );
+
+    // cv::remap needs a dense map
+    projectionOptions mapOptions = options;
+    if( options.iEngine == ENGINE_OPENCV )
+        mapOptions.lfGridThreshold = 0.0;
+
+    projectionMap mapVV;
+
+    if( !geometryMap( geometryVV, vV.iWidth, vV.iHeight, mapOptions, mapVV ) )
+        return NULL;
+
+    // views are rendered from a whole panorama, which is read in place
+    planTraversal( mapVV, iPixelBytes, 1 );
+    mapVV.iLayout = options.iLayout == LAYOUT_AUTO ? (int) LAYOUT_ROWS : options.iLayout;
+
+    #pragma omp critical(viewMapCache)
+    {
+        pMap = &viewMapCache.insert( std::make_pair( key.str(), mapVV ) ).first->second;
+    }
+
+    return pMap;
+};
+
+/*********************************************************************
+*  Render virtual views of an EQR image
+*
+**********************************************************************/
+
+bool  eqrToViews (
+            const std::string & input_image,
+            const std::vector<virtualView> & views,
+            const std::string & output_directory,
+            const projectionOptions & options )
+{
+    // one output image per view, named after the EQR image
+    std::vector<size_t> pending;
+    std::vector<std::string> output_images;
+
+    for( size_t k = 0; k < views.size(); ++k )
+    {
+        const std::string output_image_filename = output_directory + "/" + stlplus::basename_part( input_image ) + "-" + views[k].sName + ".tiff";
+
+        // views already rendered are skipped, so that an interrupted image can be resumed
+        if( stlplus::file_exists( output_image_filename ) )
+            continue;
+
+        pending.push_back( k );
+        output_images.push_back( output_image_filename );
+    }
+
+    if( pending.empty() )
+      return true;
+
+    // stage timing, in seconds
+    std::chrono::steady_clock::time_point tStage = std::chrono::steady_clock::now();
+
+    /* EQR image is decoded once for all views */
+    std::vector<cv::Mat> eqr_imgs( 1 );
+
+    if( !readEqrImage( input_image, options, eqr_imgs[0] ) )
+      return false;
+
+    if( options.iEngine != ENGINE_OPENCV && !selectKernel( eqr_imgs[0].depth(), eqr_imgs[0].channels(), options.iInterpolation ) )
+    {
+      std::cerr << " Unsupported number of planes " << eqr_imgs[0].channels() << " in " << input_image << std::endl;
+      return false;
+    }
+
+    const double lfReadTime = stageTime( tStage );
+
+    if( options.bTiming )
+      std::cerr << " Image " << input_image << " : read " << lfReadTime << " s" << std::endl;
+
+    bool bProjected = true;
+
+    /* Views are rendered in parallel, the kernels of each view run on one thread */
+    #pragma omp parallel for schedule(dynamic) reduction(&&:bProjected)
+    for( int k = 0; k < (int) pending.size(); ++k )
+    {
+        // previews keep the field of view, at a reduced size
+        virtualView vV = views[pending[k]];
+        vV.iWidth  /= options.iPreview;
+        vV.iHeight /= options.iPreview;
+
+        std::chrono::steady_clock::time_point tView = std::chrono::steady_clock::now();
+
+        const projectionMap * pMap = cachedViewMap( vV, eqr_imgs[0].cols, eqr_imgs[0].elemSize(), options );
+
+        if( !pMap )
+        {
+            std::cerr << " Inaccurate projection map for view " << vV.sName << std::endl;
+            bProjected = false;
+            continue;
+        }
+
+        const double lfMapTime = stageTime( tView );
+
+        std::vector<cv::Mat> out_imgs( 1 );
+        out_imgs[0].create( vV.iHeight, vV.iWidth, eqr_imgs[0].type() );
+
+        if( options.iEngine == ENGINE_OPENCV )
+            remapFrames( eqr_imgs, *pMap, options.iInterpolation, out_imgs );
+        else
+            selectKernel( eqr_imgs[0].depth(), eqr_imgs[0].channels(), options.iInterpolation, pMap->iLayout )( eqr_imgs, *pMap, out_imgs );
+
+        const double lfResampleTime = stageTime( tView );
+
+        bProjected = writeGnomonicImage( out_imgs[0], output_images[k], options ) && bProjected;
+
+        if( options.bTiming )
+        {
+            #pragma omp critical(timingReport)
+            std::cerr << " View " << vV.sName << " :"
+                      << " map "      << lfMapTime      << " s,"
+                      << " resample " << lfResampleTime << " s,"
+                      << " write "    << stageTime( tView ) << " s" << std::endl;
+        }
+    }
+
+    return bProjected;
+};
+
+/*********************************************************************
+*  Reproject points between sensor and EQR panorama
+*
+**********************************************************************/
+
+bool  reprojectPoints (
+            const size_t & sensor_index,
+            const std::string & mount_point,
+            const std::string & mac_address,
+            const int & normalizedFocal,
+            const double & focal,
+            const bool & bToSensor,
+            const std::vector<double> & points,
+            std::vector<double> & projected,
+            const projectionOptions & options )
+{
+    sensorData sensorSD;
+
+    if( !cachedCalibrationData( sensorSD, sensor_index, mount_point, mac_address ) )
+    {
+        std::cerr << " Failed to load calibration of channel " << sensor_index << std::endl;
+        return false;
+    }
+
+    // points are given in the full panorama, not in the EQR tile of the channel
+    sensorSD.lfXPosition = 0.0;
+    sensorSD.lfYPosition = 0.0;
+
+    gnomonicGeometry  geometrySD;
+    sensorGeometry( sensorSD, normalizedFocal, focal, NULL, options, geometrySD );
+
+    projected.resize( points.size() );
+
+    if( points.size() >= 2 )
+        selectPointKernel( bToSensor, options.bFastMath )( geometrySD, &points[0], points.size() / 2, &projected[0] );
+
+    return true;
+};
+
+/*********************************************************************
+*  Reproject points of a CSV file
+*
+**********************************************************************/
+
+bool  reprojectPointFile (
+            const std::string & input_points,
+            const std::string & output_points,
+            const std::string & mount_point,
+            const std::string & mac_address,
+            const int & normalizedFocal,
+            const double & focal,
+            const bool & bToSensor,
+            const projectionOptions & options )
+{
+    std::ifstream file( input_points.c_str() );
+
+    if( !file.is_open() )
+    {
+        std::cerr << " Cannot open point file " << input_points << std::endl;
+        return false;
+    }
+
+    // points are gathered by channel, each channel being projected in one call
+    std::map<size_t, std::vector<double> > points;
+    std::vector< std::pair<size_t, size_t> > order;
+
+    std::string sLine;
+    size_t iLine = 0;
+
+    while( std::getline( file, sLine ) )
+    {
+        ++iLine;
+
+        if( sLine.empty() || sLine[0] == '#' || sLine == "\r" )
+            continue;
+
+        std::vector<string>  fields;
+        split( sLine, ",", fields );
+
+        char * pEnd = NULL;
+        bool bValid = fields.size() == 3;
+
+        const long lChannel = bValid ? strtol( fields[0].c_str(), &pEnd, 10 ) : -1;
+        bValid = bValid && lChannel >= 0 && pEnd != fields[0].c_str() && *pEnd == '\0';
+
+        double lfCoordinates[2];
+
+        for( int i = 0; bValid && i < 2; ++i )
+        {
+            lfCoordinates[i] = strtod( fields[i + 1].c_str(), &pEnd );
+            bValid = pEnd != fields[i + 1].c_str() && ( *pEnd == '\0' || *pEnd == '\r' );
+        }
+
+        if( !bValid )
+        {
+            std::cerr << " Invalid point at line " << iLine << " of " << input_points << std::endl;
+            return false;
+        }
+
+        std::vector<double> & channelPoints = points[lChannel];
+        order.push_back( std::make_pair( (size_t) lChannel, channelPoints.size() ) );
+        channelPoints.push_back( lfCoordinates[0] );
+        channelPoints.push_back( lfCoordinates[1] );
+    }
+
+    std::map<size_t, std::vector<double> > projected;
+
+    for( std::map<size_t, std::vector<double> >::const_iterator it = points.begin(); it != points.end(); ++it )
+    {
+        if( !reprojectPoints( it->first, mount_point, mac_address, normalizedFocal, focal, bToSensor, it->second, projected[it->first], options ) )
+            return false;
+    }
+
+    /* Projected points are written in input order, renamed once complete */
+    const std::string partial_points = output_points + "." + workerName() + ".partial";
+
+    std::ofstream outputFile;
+    if( !output_points.empty() )
+    {
+        outputFile.open( partial_points.c_str() );
+
+        if( !outputFile.is_open() )
+        {
+            std::cerr << " Cannot create point file " << output_points << std::endl;
+            return false;
+        }
+    }
+
+    std::ostream & output = output_points.empty() ? std::cout : outputFile;
+    output.precision( 10 );
+
+    for( size_t k = 0; k < order.size(); ++k )
+    {
+        const double * pPoint = &projected[order[k].first][order[k].second];
+        output << order[k].first << "," << pPoint[0] << "," << pPoint[1] << "\n";
+    }
+
+    output.flush();
+
+    if( output_points.empty() )
+        return output.good();
+
+    outputFile.close();
+
+    if( outputFile.fail() || rename( partial_points.c_str(), output_points.c_str() ) != 0 )
+    {
+        std::cerr << " Cannot write point file " << output_points << std::endl;
+        unlink( partial_points.c_str() );
+        return false;
+    }
+
+    return true;
+};
+
+/*********************************************************************
+*  Project EQR image
+*
+**********************************************************************/
+
+bool  eqrToGnomonic (
+            const std::string & input_image,
+            const std::string & output_directory,
+            const std::string & mount_point,
+            const std::string & mac_address,
+            const int & normalizedFocal,
+            const double & focal,
+            const projectionOptions & options )
+{
+    return eqrToGnomonicFrames(
+            std::vector<std::string>( 1, input_image ),
+            output_directory,
+            mount_point,
+            mac_address,
+            normalizedFocal,
+            focal,
+            options );
 };
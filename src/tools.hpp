@@ -92,6 +92,7 @@
 #include <opencv/cv.h>
 #include <opencv/highgui.h>
 #include <cstring>
+#include <map>
 
 using namespace std;
 using namespace cv;
@@ -168,6 +169,187 @@ struct sensorData
 
 };
 
+/******************************************************************************
+* frameAttitude
+*****************************************************************************/
+
+/*! \struct frameAttitude
+* \brief structure used to store the attitude of the camera for one frame
+*
+* \var frameAttitude::lfRoll
+*  Roll around the forward axis (in radian)
+* \var frameAttitude::lfPitch
+*  Pitch, as the elevation of the sensors (in radian)
+* \var frameAttitude::lfYaw
+*  Yaw, as the azimuth of the sensors (in radian)
+*/
+
+struct frameAttitude
+{
+  double lfRoll  = 0.0;
+  double lfPitch = 0.0;
+  double lfYaw   = 0.0;
+};
+
+/******************************************************************************
+* projectionOptions
+*****************************************************************************/
+
+/*! \enum planeMode
+* \brief planes of the EQR tile that are projected
+*/
+
+enum planeMode
+{
+  PLANES_COLOR,     /*!< BGR planes, converted from the tile if needed */
+  PLANES_LUMINANCE, /*!< luminance plane, converted from BGR during decoding */
+  PLANES_RAW        /*!< planes of the tile, as stored in the file */
+};
+
+/*! \enum interpolationMethod
+* \brief interpolation method used to sample the EQR tile
+*/
+
+enum interpolationMethod
+{
+  INTERPOLATION_NEAREST,  /*!< nearest neighbour */
+  INTERPOLATION_BILINEAR, /*!< bilinear */
+  INTERPOLATION_BICUBIC   /*!< bicubic, a = -0.5 */
+};
+
+/*! \enum projectionEngine
+* \brief implementation of the gnomonic projection
+*/
+
+enum projectionEngine
+{
+  ENGINE_KERNEL,   /*!< template kernels of kernels.hpp */
+  ENGINE_GNOMONIC, /*!< libgnomonic, for 8 bits BGR tiles and bicubic interpolation */
+  ENGINE_OPENCV,   /*!< cv::remap with fixed point maps */
+  ENGINE_AUTO      /*!< libgnomonic for the tiles and options it supports, kernels otherwise */
+};
+
+/*! \enum sourceLayout
+* \brief memory layout of the EQR tile during resampling
+*/
+
+enum sourceLayout
+{
+  LAYOUT_AUTO,   /*!< chosen from the footprint of the map, see planTraversal */
+  LAYOUT_ROWS,   /*!< row major, as decoded */
+  LAYOUT_BLOCKS, /*!< copy in blocks of 8x8 pixels */
+  LAYOUT_PLANES  /*!< planes resampled separately, then interleaved */
+};
+
+/*! \enum outputColorspace
+* \brief colorspace of the sensor images, converted from BGR when the samples are stored
+*/
+
+enum outputColorspace
+{
+  COLORSPACE_BGR,      /*!< planes of the EQR tile */
+  COLORSPACE_GRAY,     /*!< BT.601 luma */
+  COLORSPACE_YCBCR444, /*!< BT.601 full range YCbCr, interleaved */
+  COLORSPACE_YCBCR420  /*!< BT.601 full range YCbCr 4:2:0, luma plane followed by the Cb and Cr planes side by side */
+};
+
+/*! \struct projectionOptions
+* \brief structure used to store options of the gnomonic projection
+*
+* \var projectionOptions::iPlanes
+*  Planes of the EQR tile that are projected (see planeMode)
+* \var projectionOptions::iInterpolation
+*  Interpolation method (see interpolationMethod)
+* \var projectionOptions::iEngine
+*  Implementation of the projection (see projectionEngine)
+* \var projectionOptions::bFastMath
+*  Compute the projection map in single precision with polynomial approximations
+* \var projectionOptions::bCheckMap
+*  Compare the projection map with the exact one, and fail above 0.01 pixel
+*  (or above the grid threshold)
+* \var projectionOptions::lfGridThreshold
+*  Maximal deviation of the sparse grid map in pixels, 0 for a dense map
+* \var projectionOptions::bTiming
+*  Report the time spent in each stage of the projection
+* \var projectionOptions::iLayout
+*  Memory layout of the EQR tile during resampling (see sourceLayout)
+* \var projectionOptions::sWarp
+*  File with the warp of the sensor images composed with the projection
+*  (see eqrToGnomonicFrames), empty without warp
+* \var projectionOptions::sPhotometry
+*  File with the photometric correction of the sensor images (see
+*  eqrToGnomonicFrames), empty without correction
+* \var projectionOptions::iColorspace
+*  Colorspace of the sensor images (see outputColorspace)
+* \var projectionOptions::iQuality
+*  JPEG quality of 4:2:0 sensor images, when gnoproj is built with libjpeg
+* \var projectionOptions::iLevels
+*  Number of reduced levels (1/2, 1/4, 1/8) written with each sensor image,
+*  0 without pyramid
+* \var projectionOptions::iPreview
+*  Reduction factor (1, 2, 4 or 8) of the decoded EQR images and of the sensor
+*  geometry, 1 for full resolution
+* \var projectionOptions::iRoiX
+*  x coordinate of the region of interest in the sensor image
+* \var projectionOptions::iRoiY
+*  y coordinate of the region of interest in the sensor image
+* \var projectionOptions::iRoiWidth
+*  Width of the region of interest, 0 to project the whole sensor image
+* \var projectionOptions::iRoiHeight
+*  Height of the region of interest
+* \var projectionOptions::pAttitudes
+*  Attitude of each frame, keyed by frame timestamp, NULL without attitude
+*  correction. The table is owned by the caller.
+*/
+
+struct projectionOptions
+{
+  int  iPlanes        = PLANES_COLOR;
+  int  iInterpolation = INTERPOLATION_BICUBIC;
+  int  iEngine        = ENGINE_AUTO;
+  bool bFastMath      = false;
+  bool bCheckMap      = false;
+
+  double lfGridThreshold = 0.0;
+
+  bool bTiming        = false;
+  int  iLayout        = LAYOUT_AUTO;
+
+  std::string sWarp   = "";
+  std::string sPhotometry = "";
+
+  int  iColorspace    = COLORSPACE_BGR;
+  int  iQuality       = 95;
+  int  iLevels        = 0;
+  int  iPreview       = 1;
+
+  int  iRoiX          = 0;
+  int  iRoiY          = 0;
+  int  iRoiWidth      = 0;
+  int  iRoiHeight     = 0;
+
+  const std::map<std::string, frameAttitude> * pAttitudes = NULL;
+};
+
+/*********************************************************************
+*  Split an input string with a delimiter
+*
+**********************************************************************/
+
+/*! \brief String splitting
+*
+* This function splits a string with a delimiter and fills a vector with
+* the resulting substrings.
+*
+* \param src         The string to split
+* \param delim       The delimiter
+* \param vec_value   The vector that will be filled with substrings
+*
+* \return bool value that says if the delimiter was found or not
+*/
+
+bool split ( const std::string src, const std::string& delim, std::vector<std::string>& vec_value ) ;
+
 /*********************************************************************
 *  load calibration data related to elphel cameras
 *
@@ -191,6 +373,322 @@ bool  loadCalibrationData( sensorData & sD,
             const std::string & sMountPoint,
             const std::string & smacAddress) ;
 
+/*********************************************************************
+*  Parse a region of interest
+*
+**********************************************************************/
+
+/*! \brief Region of interest parsing
+*
+* This function parses a region of interest of the sensor images given as
+* x,y,w,h in pixels, and stores it in the projection options.
+*
+* \param sRoi      Region of interest
+* \param options   Projection options updated
+*
+* \return bool value that says if the region is valid or not
+*/
+
+bool  parseRoi( const std::string & sRoi,
+            projectionOptions & options ) ;
+
+/*********************************************************************
+*  load per-frame attitudes
+*
+**********************************************************************/
+
+/*! \brief Attitude loading
+*
+* This function reads the attitude of the camera for each frame, for example
+* from IMU data, in a CSV file with one line per frame :
+*
+*   timestamp,roll,pitch,yaw
+*
+* where the timestamp is the one of the EQR image names (e.g. 1412345678_123456)
+* and the angles are given in degrees. Empty lines and lines starting with #
+* are ignored.
+*
+* \param sFilename   Path of the CSV file
+* \param attitudes   Map filled with the attitude of each frame
+*
+* \return bool value that says if the file could be read or not
+*/
+
+bool  loadAttitudes( const std::string & sFilename,
+            std::map<std::string, frameAttitude> & attitudes ) ;
+
+/*********************************************************************
+*  load calibration data through a cache
+*
+**********************************************************************/
+
+/*! \brief Cached calibration data loading
+*
+* Same as loadCalibrationData, the calibration of each sensor being parsed
+* once per process and then served from memory. Safe to call from parallel
+* regions.
+*
+* \param sD             An object sensorData that will be affected with calibration data
+* \param sensor_index   the sensor index of elphel camera (between 0 and Channels-1)
+* \param sMountPoint    The mount point of the camera folder
+* \param smacAddress    The mac address of the considered elphel camera
+*
+* \return bool value that says if the loading was sucessfull or not
+*/
+
+bool  cachedCalibrationData( sensorData & sD,
+            const size_t      & sensor_index,
+            const std::string & sMountPoint,
+            const std::string & smacAddress) ;
+
+/*********************************************************************
+*  output image name
+*
+**********************************************************************/
+
+/*! \brief Output image name
+*
+* This function builds the name of the gnomonic image produced from an
+* EQR image, so that callers can check if a projection was already done.
+*
+* \param  input_image      Name of EQR input image
+* \param  output_directory Path of the directory where you want to put your images
+* \param  normalizedFocal  0 or 1. If 1, use normalized focal, else use calibration focal length
+* \param  sSuffix          Suffix of the output image name (see outputImageSuffix)
+*
+* \return the complete path of the output image
+*/
+
+std::string  outputImageName (
+            const std::string & input_image,
+            const std::string & output_directory,
+            const int & normalizedFocal,
+            const std::string & sSuffix = ".tiff" ) ;
+
+/*! \brief Output image extension
+*
+* This function returns the extension of the gnomonic images: ".jpg" for
+* 4:2:0 images when gnoproj is built with libjpeg, ".tiff" otherwise.
+*
+* \param  options          Projection options
+*
+* \return the extension of the output images
+*/
+
+std::string  outputImageExtension( const projectionOptions & options ) ;
+
+/*! \brief Output image suffix
+*
+* This function returns the end of the names of the gnomonic images: the
+* region of interest, if any, as -ROIx_y_wxh, followed by the extension.
+*
+* \param  options          Projection options
+*
+* \return the suffix of the output image names
+*/
+
+std::string  outputImageSuffix( const projectionOptions & options ) ;
+
+/*********************************************************************
+*  projection of frames of a channel
+*
+**********************************************************************/
+
+/*! \brief EQR to gnomonic projection of several frames
+*
+* This function projects EQR images of the same channel, for example
+* consecutive frames of a batch. The calibration is loaded and the projection
+* map is computed once, and the kernel resamples all frames in one pass over
+* the map. Images already projected, or whose channel, type or size differ
+* from the first one, are reported and skipped.
+*
+* With a warp file, read with cv::FileStorage, the sensor images are warped
+* in the same resampling pass, for example undistorted and rectified, and
+* the output images get the size of the warp. The warp of channel N is read
+* from the node channelN, or from the root node, either as a dense map
+* (mapX and mapY, sensor coordinates of each output pixel) or as a camera
+* model given to cv::initUndistortRectifyMap (camera_matrix,
+* distortion_coefficients and optionally rectification_matrix,
+* projection_matrix, image_width and image_height).
+*
+* With a photometric correction file, also read with cv::FileStorage from the
+* node channelN or the root node, the samples are multiplied before they are
+* stored by the product of a gain, a flat field gain_map (resized to the
+* output images if needed) and 1 + k1 r^2 + k2 r^4 + ... for the vignetting
+* coefficients [k1, k2, ...], r being the distance to vignetting_center (the
+* center of the image by default) relative to the half diagonal. The planes
+* are multiplied by the white_balance gains, one per plane. The center and the
+* diagonal are in full resolution pixels of the output images, previews and
+* reduced levels being corrected at the same positions.
+*
+* With a region of interest, only the rows and columns of the EQR tiles
+* sampled by the region are decoded (read from the strips of TIFF images when
+* gnoproj is built with libtiff), and the region is projected alone.
+*
+* With reduced levels, the level N of a sensor image is written next to it,
+* with the suffix -LN (e.g. -RECT-SENSOR-L1.tiff for 1/2), before the sensor
+* image itself.
+*
+* \param  input_images     Names of EQR input images, all of the same channel
+* \param  output_directory Path of the directory where you want to put your images
+* \param  mount_point      The mount point of the camera folder
+* \param  mac_address      The mac address of the considered elphel camera
+* \param  normalizedFocal  0 or 1. If 1, use normalized focal, else use calibration focal length
+* \param  focal            Focal Length in mm
+* \param  options          Options of the projection
+*
+* \return bool value that says if all projections were sucessfull or not
+*/
+
+bool  eqrToGnomonicFrames (
+            const std::vector<std::string> & input_images,
+            const std::string & output_directory,
+            const std::string & mount_point,
+            const std::string & mac_address,
+            const int & normalizedFocal,
+            const double & focal,
+            const projectionOptions & options = projectionOptions() ) ;
+
+/*********************************************************************
+*  projection of the channels of a full panorama
+*
+**********************************************************************/
+
+/*! \brief EQR to gnomonic projection of a full panorama
+*
+* This function projects the channels of a frame from its full EQR panorama,
+* instead of one EQR tile per channel. The panorama is decoded once and the
+* channels are projected in parallel, each channel being resampled on one
+* thread. Output images are named as if projected from the EQR tiles of the
+* frame, and outputs that already exist are skipped.
+*
+* \param  input_panorama   Name of the EQR panorama, whose name starts with the frame timestamp
+* \param  channels         Channels to project, all channels of the camera if empty
+* \param  output_directory Path of the directory where you want to put your images
+* \param  mount_point      The mount point of the camera folder
+* \param  mac_address      The mac address of the considered elphel camera
+* \param  normalizedFocal  0 or 1. If 1, use normalized focal, else use calibration focal length
+* \param  focal            Focal Length in mm
+* \param  options          Options of the projection
+*
+* \return bool value that says if all projections were sucessfull or not
+*/
+
+bool  eqrPanoramaToGnomonic (
+            const std::string & input_panorama,
+            const std::vector<size_t> & channels,
+            const std::string & output_directory,
+            const std::string & mount_point,
+            const std::string & mac_address,
+            const int & normalizedFocal,
+            const double & focal,
+            const projectionOptions & options = projectionOptions() ) ;
+
+/*********************************************************************
+*  rendering of virtual views
+*
+**********************************************************************/
+
+struct virtualView;
+
+/*! \brief EQR to virtual views rendering
+*
+* This function renders virtual gnomonic cameras (see views.hpp) from an EQR
+* panorama, for example the faces of a cube map. The image is decoded once
+* and the views are rendered in parallel, each view on one thread. The
+* projection map of each view is computed once and cached for the following
+* images. Outputs are named after the EQR image and the view, and outputs that
+* already exist are skipped. The libgnomonic engine is not used for views.
+*
+* \param  input_image      Name of the EQR panorama
+* \param  views            Virtual views to render
+* \param  output_directory Path of the directory where you want to put your images
+* \param  options          Options of the projection
+*
+* \return bool value that says if all views were rendered or not
+*/
+
+bool  eqrToViews (
+            const std::string & input_image,
+            const std::vector<virtualView> & views,
+            const std::string & output_directory,
+            const projectionOptions & options = projectionOptions() ) ;
+
+/*********************************************************************
+*  reprojection of points
+*
+**********************************************************************/
+
+/*! \brief Point reprojection between sensor and EQR panorama coordinates
+*
+* This function projects points with the geometry of the image projection,
+* without rendering any image. Points are given as interleaved (x,y)
+* coordinates, in pixels of the sensor image or of the full EQR panorama (not
+* of the EQR tile of the channel). The region of interest and the preview
+* scale of the options apply to the sensor coordinates as for images, the
+* preview scale also to the panorama coordinates. Panorama points behind the
+* sensor get NaN coordinates. The calibration is loaded through
+* cachedCalibrationData, and points are projected in parallel by the kernels
+* of kernels.hpp : exact and scalar, or vectorized in single precision with
+* the fast math option (see selectPointKernel).
+*
+* \param  sensor_index     The sensor index of elphel camera (between 0 and Channels-1)
+* \param  mount_point      The mount point of the camera folder
+* \param  mac_address      The mac address of the considered elphel camera
+* \param  normalizedFocal  0 or 1. If 1, use normalized focal, else use calibration focal length
+* \param  focal            Focal Length in mm
+* \param  bToSensor        Project panorama points to the sensor instead of sensor points to the panorama
+* \param  points           Interleaved coordinates of the points
+* \param  projected        Interleaved coordinates of the projected points
+* \param  options          Options of the projection
+*
+* \return bool value that says if the calibration could be loaded or not
+*/
+
+bool  reprojectPoints (
+            const size_t & sensor_index,
+            const std::string & mount_point,
+            const std::string & mac_address,
+            const int & normalizedFocal,
+            const double & focal,
+            const bool & bToSensor,
+            const std::vector<double> & points,
+            std::vector<double> & projected,
+            const projectionOptions & options = projectionOptions() ) ;
+
+/*! \brief Point file reprojection
+*
+* This function reprojects the points of a CSV file with one line per point :
+*
+*   channel,x,y
+*
+* with reprojectPoints, the points of each channel in one call. The projected
+* points are written in the same order and format, with nan coordinates for
+* points that do not project. Empty lines and lines starting with # are
+* ignored.
+*
+* \param  input_points     Path of the CSV file of points
+* \param  output_points    Path of the CSV file of projected points, standard output if empty
+* \param  mount_point      The mount point of the camera folder
+* \param  mac_address      The mac address of the considered elphel camera
+* \param  normalizedFocal  0 or 1. If 1, use normalized focal, else use calibration focal length
+* \param  focal            Focal Length in mm
+* \param  bToSensor        Project panorama points to the sensor instead of sensor points to the panorama
+* \param  options          Options of the projection
+*
+* \return bool value that says if all points were reprojected or not
+*/
+
+bool  reprojectPointFile (
+            const std::string & input_points,
+            const std::string & output_points,
+            const std::string & mount_point,
+            const std::string & mac_address,
+            const int & normalizedFocal,
+            const double & focal,
+            const bool & bToSensor,
+            const projectionOptions & options = projectionOptions() ) ;
+
 /*********************************************************************
 *  call to libgnomonic for projection
 *
@@ -199,7 +697,11 @@ bool  loadCalibrationData( sensorData & sD,
 /*! \brief EQR to gnomonic projection
 *
 * This function takes an EQR image and apply a gnomonic projection in order
-* to retreive the original sensor image.
+* to retreive the original sensor image. The image is projected at its native
+* depth with the kernels of kernels.hpp. With the libgnomonic engine, 8 bits
+* BGR images are projected with lg_ttg_elphel or lg_ttg_center instead, as
+* they are by default when no option needs the kernels (see ENGINE_AUTO), and
+* with the OpenCV engine, images are projected with cv::remap.
 *
 * \param  input_image      Name of EQR input image
 * \param  output_directory Path of the directory where you want to put your images
@@ -207,6 +709,7 @@ bool  loadCalibrationData( sensorData & sD,
 * \param  mac_address      The mac address of the considered elphel camera
 * \param  normalizedFocal  0 or 1. If 1, use normalized focal, else use calibration focal length
 * \param  focal            Focal Length in mm
+* \param  options          Options of the projection
 *
 * \return bool value that says if the projection was sucessfull or not
 */
@@ -217,6 +720,7 @@ bool  eqrToGnomonic (
             const std::string & mount_point,
             const std::string & mac_address,
             const int & normalizedFocal,
-            const double & focal ) ;
+            const double & focal,
+            const projectionOptions & options = projectionOptions() ) ;
 
 #endif
@@ -0,0 +1,263 @@
+/*
+* gnoproj
+*
+* Copyright (c) 2013-2015 FOXEL SA - http://foxel.ch
+* Please read <http://foxel.ch/license> for more information.
+*
+*
+* Author(s):
+*
+*      Stéphane Flotron <s.flotron@foxel.ch>
+*
+* Contributor(s):
+*
+*      Luc Deschenaux <luc.deschenaux@foxel.ch>
+*
+*
+* This file is part of the FOXEL project <http://foxel.ch>.
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Affero General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Affero General Public License for more details.
+*
+* You should have received a copy of the GNU Affero General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*
+* Additional Terms:
+*
+*      You are required to preserve legal notices and author attributions in
+*      that material or in the Appropriate Legal Notices displayed by works
+*      containing it.
+*
+*      You are required to attribute the work as explained in the "Usage and
+*      Attribution" section of <http://foxel.ch/license>.
+*/
+
+#include "views.hpp"
+#include "tools.hpp"
+#include <cstdlib>
+#include <sstream>
+
+using namespace std;
+
+// largest width or height of a view
+static const int iMaxSize = 65536;
+
+/*********************************************************************
+*  parse a positive integer
+*
+**********************************************************************/
+
+static bool  parsePositive( const std::string & sValue,
+            int & iValue )
+{
+    char * pEnd = NULL;
+    const long lValue = strtol( sValue.c_str(), &pEnd, 10 );
+
+    if( sValue.empty() || *pEnd != '\0' || lValue < 1 || lValue > iMaxSize )
+        return false;
+
+    iValue = lValue;
+    return true;
+}
+
+/*********************************************************************
+*  check a view name
+*
+**********************************************************************/
+
+// names are appended to the output image names, they cannot leave the
+// output directory nor hold control characters
+static bool  validName( const std::string & sName )
+{
+    if( sName.empty() || sName.find( '/' ) != std::string::npos || sName.find( '\\' ) != std::string::npos
+     || sName.find( ".." ) != std::string::npos )
+        return false;
+
+    for( size_t i = 0; i < sName.size(); ++i )
+    {
+        const unsigned char c = sName[i];
+
+        if( c < 0x20 || c == 0x7f )
+            return false;
+    }
+
+    return true;
+}
+
+/*********************************************************************
+*  preset view sets
+*
+**********************************************************************/
+
+static void  addView( std::vector<virtualView> & views,
+            const std::string & sName,
+            const double & lfAzimuth,
+            const double & lfElevation,
+            const double & lfFov,
+            const int & iSize )
+{
+    virtualView vV;
+
+    vV.sName       = sName;
+    vV.lfAzimuth   = lfAzimuth   * LG_PI / 180.0;
+    vV.lfElevation = lfElevation * LG_PI / 180.0;
+    vV.lfFov       = lfFov       * LG_PI / 180.0;
+    vV.iWidth      = iSize;
+    vV.iHeight     = iSize;
+
+    views.push_back( vV );
+}
+
+static bool  presetViews( const std::vector<std::string> & preset,
+            std::vector<virtualView> & views )
+{
+    int iSize = 1024;
+
+    if( preset[0] == "cube" )
+    {
+        if( preset.size() > 2 || ( preset.size() == 2 && !parsePositive( preset[1], iSize ) ) )
+            return false;
+
+        addView( views, "front",   0.0,   0.0, 90.0, iSize );
+        addView( views, "right",  90.0,   0.0, 90.0, iSize );
+        addView( views, "back",  180.0,   0.0, 90.0, iSize );
+        addView( views, "left",  270.0,   0.0, 90.0, iSize );
+        addView( views, "up",      0.0,  90.0, 90.0, iSize );
+        addView( views, "down",    0.0, -90.0, 90.0, iSize );
+
+        return true;
+    }
+
+    if( preset[0] == "ring" )
+    {
+        int iCount = 0;
+
+        if( preset.size() < 2 || preset.size() > 3 || !parsePositive( preset[1], iCount )
+         || ( preset.size() == 3 && !parsePositive( preset[2], iSize ) ) )
+            return false;
+
+        // adjacent views overlap by a quarter, up to the 120 degrees a gnomonic view can reasonably cover
+        const double lfFov = std::min( 1.25 * 360.0 / iCount, 120.0 );
+
+        for( int k = 0; k < iCount; ++k )
+        {
+            std::ostringstream name;
+            name << "ring" << k;
+
+            addView( views, name.str(), k * 360.0 / iCount, 0.0, lfFov, iSize );
+        }
+
+        return true;
+    }
+
+    return false;
+}
+
+/*********************************************************************
+*  load a view set
+*
+**********************************************************************/
+
+bool  loadViewSet( const std::string & sViewSet,
+            std::vector<virtualView> & views )
+{
+    views.clear();
+
+    std::vector<string>  preset;
+    split( sViewSet, ":", preset );
+
+    if( preset[0] == "cube" || preset[0] == "ring" )
+        return presetViews( preset, views );
+
+    try
+    {
+        cv::FileStorage fs( sViewSet, cv::FileStorage::READ );
+        const cv::FileNode viewNodes = fs.isOpened() ? fs["views"] : cv::FileNode();
+
+        if( !viewNodes.isSeq() )
+        {
+            std::cerr << " No views sequence in " << sViewSet << std::endl;
+            return false;
+        }
+
+        for( size_t k = 0; k < viewNodes.size(); ++k )
+        {
+            const cv::FileNode node = viewNodes[(int) k];
+
+            std::ostringstream name;
+            name << "view" << k;
+
+            virtualView vV;
+            vV.sName       = node["name"].empty() ? name.str() : (std::string) node["name"];
+            vV.lfAzimuth   = (double) node["azimuth"]   * LG_PI / 180.0;
+            vV.lfElevation = (double) node["elevation"] * LG_PI / 180.0;
+            vV.lfRoll      = (double) node["roll"]      * LG_PI / 180.0;
+            vV.lfFov       = ( node["fov"].empty() ? 90.0 : (double) node["fov"] ) * LG_PI / 180.0;
+            vV.iWidth      = node["width"].empty()  ? 1024      : (int) node["width"];
+            vV.iHeight     = node["height"].empty() ? vV.iWidth : (int) node["height"];
+
+            if( !validName( vV.sName ) )
+            {
+                std::cerr << " Invalid name of view " << k << " in " << sViewSet
+                          << ", names cannot be empty nor contain /, \\, .. or control characters" << std::endl;
+                return false;
+            }
+
+            // views are written to <image>-<name>.tiff, names must be unique
+            for( size_t i = 0; i < views.size(); ++i )
+            {
+                if( views[i].sName == vV.sName )
+                {
+                    std::cerr << " Views " << i << " and " << k << " of " << sViewSet << " have the same name " << vV.sName << std::endl;
+                    return false;
+                }
+            }
+
+            if( vV.lfFov <= 0.0 || vV.lfFov >= LG_PI || vV.iWidth < 1 || vV.iHeight < 1 || vV.iWidth > iMaxSize || vV.iHeight > iMaxSize )
+            {
+                std::cerr << " Invalid view " << k << " in " << sViewSet << std::endl;
+                return false;
+            }
+
+            views.push_back( vV );
+        }
+    }
+    catch( const cv::Exception & e )
+    {
+        std::cerr << " Cannot read view set " << sViewSet << " : " << e.what() << std::endl;
+        return false;
+    }
+
+    return !views.empty();
+};
+
+/*********************************************************************
+*  gnomonic geometry of virtual views
+*
+**********************************************************************/
+
+void  viewGeometry( const virtualView & vV,
+            const double & lfPanoramaWidth,
+            gnomonicGeometry & gG )
+{
+    // distances on the image plane are measured in pixels
+    gG.lfPixelSize   = 1.0;
+    gG.lfMapWidth    = lfPanoramaWidth;
+    gG.lfMapHeight   = lfPanoramaWidth / 2.0;
+    gG.lfCornerX     = 0.0;
+    gG.lfCornerY     = 0.0;
+
+    gG.lfpx0         = vV.iWidth  / 2.0;
+    gG.lfpy0         = vV.iHeight / 2.0;
+    gG.lfFocalLength = vV.iWidth  / ( 2.0 * std::tan( vV.lfFov / 2.0 ) );
+
+    rotationMatrix( vV.lfAzimuth + LG_PI, vV.lfElevation, vV.lfRoll, gG.lfMatrix );
+};
@@ -0,0 +1,140 @@
+/*
+* gnoproj
+*
+* Copyright (c) 2013-2015 FOXEL SA - http://foxel.ch
+* Please read <http://foxel.ch/license> for more information.
+*
+*
+* Author(s):
+*
+*      Stéphane Flotron <s.flotron@foxel.ch>
+*
+* Contributor(s):
+*
+*      Luc Deschenaux <luc.deschenaux@foxel.ch>
+*
+*
+* This file is part of the FOXEL project <http://foxel.ch>.
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Affero General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Affero General Public License for more details.
+*
+* You should have received a copy of the GNU Affero General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*
+* Additional Terms:
+*
+*      You are required to preserve legal notices and author attributions in
+*      that material or in the Appropriate Legal Notices displayed by works
+*      containing it.
+*
+*      You are required to attribute the work as explained in the "Usage and
+*      Attribution" section of <http://foxel.ch/license>.
+*/
+
+  /*! \file views.hpp
+   * \author Stephane Flotron <s.flotron@foxel.ch>
+   */
+
+#ifndef VIEWS_HPP_
+#define VIEWS_HPP_
+
+#include "geometry.hpp"
+#include <string>
+#include <vector>
+
+/******************************************************************************
+* virtualView
+*****************************************************************************/
+
+/*! \struct virtualView
+* \brief structure used to describe a virtual gnomonic camera
+*
+* \var virtualView::sName
+*  Name of the view, appended to the output image name
+* \var virtualView::lfAzimuth
+*  Azimuth of the optical axis in panorama frame (in radian)
+* \var virtualView::lfElevation
+*  Elevation of the optical axis (in radian)
+* \var virtualView::lfRoll
+*  Roll around the optical axis (in radian)
+* \var virtualView::lfFov
+*  Horizontal field of view (in radian)
+* \var virtualView::iWidth
+*  Width of the rendered image
+* \var virtualView::iHeight
+*  Height of the rendered image
+*/
+
+struct virtualView
+{
+  std::string sName = "";
+
+  double lfAzimuth   = 0.0;
+  double lfElevation = 0.0;
+  double lfRoll      = 0.0;
+  double lfFov       = 0.0;
+
+  int iWidth  = 0;
+  int iHeight = 0;
+};
+
+/*********************************************************************
+*  load a view set
+*
+**********************************************************************/
+
+/*! \brief View set loading
+*
+* This function builds the views rendered from each EQR image. The view set
+* is either a preset or a JSON (or YAML) file read with cv::FileStorage :
+*
+*   cube[:size]          six 90 degrees faces : front, right, back, left, up and down
+*   ring:N[:size]        N views around the horizon, overlapping by a quarter
+*
+*   { "views": [ { "name": "front", "azimuth": 0, "elevation": 0, "roll": 0,
+*                  "fov": 90, "width": 1024, "height": 1024 }, ... ] }
+*
+* Angles are given in degrees, height defaults to width and width to 1024,
+* sizes are at most 65536. Names default to viewN, must be unique and cannot
+* contain /, \\, .. or control characters.
+*
+* \param sViewSet  Preset or path of the view set file
+* \param views     Vector filled with the views
+*
+* \return bool value that says if the view set is valid or not
+*/
+
+bool  loadViewSet( const std::string & sViewSet,
+            std::vector<virtualView> & views ) ;
+
+/*********************************************************************
+*  gnomonic geometry of virtual views
+*
+**********************************************************************/
+
+/*! \brief View geometry
+*
+* Geometry of a virtual camera, with the convention of the calibrated sensors
+* of centerGeometry. The principal point is at the center of the image and
+* the focal length, in pixels, follows from the field of view. The panorama
+* is assumed to be a full 2:1 equirectangular image.
+*
+* \param vV              The virtual view
+* \param lfPanoramaWidth Width of the EQR panorama
+* \param gG              Geometry filled with the view parameters
+*/
+
+void  viewGeometry( const virtualView & vV,
+            const double & lfPanoramaWidth,
+            gnomonicGeometry & gG ) ;
+
+#endif